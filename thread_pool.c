@@ -13,17 +13,49 @@
  * 2012-05-14   boyce
  * 2016-01-13	Tristan		fix bugs
  * 2016-02-25	Tristan		fix manage thread exit problem
+ * 2026-10-18	Tristan		add pending job queue
+ * 2026-10-18	Tristan		add per thread local queue and work stealing
+ * 2026-10-18	Tristan		use lock free ring for idle_q
+ * 2026-10-18	Tristan		track busy threads by state and counters instead of busy_q
+ * 2026-10-18	Tristan		add future for job completion and result
+ * 2026-10-18	Tristan		add job with inline data
+ * 2026-10-18	Tristan		add batch submission
+ * 2026-10-18	Tristan		add job priority
+ * 2026-10-18	Tristan		spin before sleeping on a futex when idle
+ * 2026-10-18	Tristan		add cpu affinity and numa aware thread placement
+ * 2026-10-18	Tristan		add thread stack size, scheduling policy and name options
+ * 2026-10-18	Tristan		sample load frequently in manage thread, stop idle threads asynchronously
+ * 2026-10-18	Tristan		create threads in manage thread only, keep a reserve of idle threads
+ * 2026-10-18	Tristan		add pool statistics
+ * 2026-10-18	Tristan		add job latency histograms
+ * 2026-10-18	Tristan		add event tracing with chrome trace export
+ * 2026-10-18	Tristan		add shutdown with drain, free the pool by the last thread if not waiting
+ * 2026-10-18	Tristan		add cancellation token and deadline of jobs
+ * 2026-10-18	Tristan		stop the timer wheel with the pool
+ * 2026-10-18	Tristan		allocate jobs and thread infos from slabs of the pool
+ * 2026-10-18	Tristan		add saturation policies
+ * 2026-10-18	Tristan		add pool groups sharing a thread budget
  *
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <sched.h>
+#include <limits.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
 
 #include "thread_pool.h"
+#include "tp_timer.h"
+#include "tp_group.h"
 
 //#define __DEBUG__
 
@@ -34,13 +66,60 @@
 #endif
 
 static int tp_init(TpThreadPool *pTp);
-static TpThreadInfo *tp_add_thread(TpThreadPool *pTp, process_job proc_fun, void *job);
+static TpThreadInfo *tp_add_thread(TpThreadPool *pTp, BOOL idle);
+static TpThreadInfo *tp_wake_thread(TpThreadPool *pTp);
+static void tp_dispatch(TpThreadPool *pTp, unsigned n);
+static TpJob *tp_fetch_job(TpThreadPool *pTp, TpThreadInfo *pThi);
+static TpJob *tp_deq_job(TpThreadPool *pTp);
+static TpJob *tp_steal_job(TpThreadPool *pTp, TpThreadInfo *pThi);
+static unsigned tp_local_job_num(TpThreadPool *pTp);
+static TpThreadInfo *tp_get_slot(TpThreadPool *pTp);
+static void tp_put_slot(TpThreadPool *pTp, unsigned idx);
 static int tp_delete_thread(TpThreadPool *pTp); 
+static void tp_retire_thread(TpThreadPool *pTp, TpThreadInfo *pThi, TpRetired *r);
+static BOOL tp_park_thread(TpThreadPool *pTp, TpThreadInfo *pThi);
+static unsigned tp_retire_parked(TpThreadPool *pTp);
+static void tp_post_manage(TpThreadPool *pTp);
+static BOOL tp_stop_accept(TpThreadPool *pTp);
+static void tp_stop_threads(TpThreadPool *pTp, BOOL wait);
+static int tp_drop_jobs(TpThreadPool *pTp);
+static void tp_release(TpThreadPool *pTp);
 static int tp_get_tp_status(TpThreadPool *pTp); 
 
+static int tp_init_nodes(TpThreadPool *pTp, const TpAttr *attr);
+static void tp_free_nodes(TpThreadPool *pTp);
+static int tp_read_cpulist(const char *path, cpu_set_t *set);
+static unsigned tp_cur_node(TpThreadPool *pTp);
+static void *tp_node_alloc(size_t size, void *node);
+
 static void *tp_work_thread(void *pthread);
 static void *tp_manage_thread(void *pthread);
-static void afterms(struct timespec *timeout,unsigned long ms);
+static void tp_job_drop(TpJob *job);
+static void tp_job_run(TpJob *job);
+static void tp_future_run(void *arg);
+static void tp_future_drop(void *arg);
+static void tp_future_done(TpFuture *f, void *result, BOOL dropped);
+static void tp_future_release(TpFuture *f);
+static BOOL tp_job_expired(TpJob *job);
+
+static void tp_reap_threads(TpThreadPool *pTp, BOOL wait);
+static unsigned long tp_now_ms(void);
+static unsigned long long tp_now_ns(void);
+static void tp_hist_add(unsigned long *count, unsigned long long *sum, unsigned long long ns);
+static unsigned long long tp_hist_value(unsigned idx);
+static unsigned long tp_hist_merge(TpThreadPool *pTp, unsigned which, unsigned long *count, unsigned long long *sum);
+static void tp_trace(TpThreadPool *pTp, unsigned type, unsigned arg);
+static unsigned tp_slab_cache(TpThreadPool *pTp);
+
+//thread stopped by the manage thread
+struct tp_retired_s {
+	pthread_t thread_id;
+	TpThreadInfo *pThi; //freed when the thread is joined
+	TpRetired *next;
+};
+
+static __thread TpThreadInfo *tp_self; //work thread info of the calling thread
+static __thread TpThreadPool *tp_manage_self; //pool managed by the calling thread
 
 /**
  * user interface. creat thread pool.
@@ -50,6 +129,18 @@ static void afterms(struct timespec *timeout,unsigned long ms);
  * 	thread pool struct instance be created successfully
  */
 TpThreadPool *tp_create(unsigned min_num, unsigned max_num) {
+	return tp_create_ex(min_num, max_num, NULL);
+}
+
+/**
+ * user interface. creat thread pool with options.
+ * para:
+ * 	num: min thread number to be created in the pool
+ * 	attr: options, only used in this call, NULL - default
+ * return:
+ * 	thread pool struct instance be created successfully
+ */
+TpThreadPool *tp_create_ex(unsigned min_num, unsigned max_num, const TpAttr *attr) {
 	TpThreadPool *pTp;
 	pTp = (TpThreadPool*) malloc(sizeof(TpThreadPool));
 
@@ -59,65 +150,152 @@ TpThreadPool *tp_create(unsigned min_num, unsigned max_num) {
 	pTp->min_th_num = min_num;
 	pTp->max_th_num = max_num;
 
-    tp_init(pTp);
+	if (tp_init_nodes(pTp, attr) != 0) {
+		fprintf(stderr, "tp_create_ex: no cpu for work threads.\n");
+		free(pTp);
+		return NULL;
+	}
+	if (attr) {
+		pTp->attr = *attr;
+		pTp->attr.cpus = NULL;
+		pTp->attr.cpu_num = 0;
+		if (attr->name) {
+			//room for "-idx"
+			strncpy(pTp->name, attr->name, TP_NAME_SIZE - 5);
+			pTp->attr.name = pTp->name;
+		}
+	}
+	if (tp_init(pTp) != 0) {
+		//threads started so far are stopped and the pool is freed
+		tp_close(pTp, TRUE);
+		return NULL;
+	}
 	return pTp;
 }
 
+void tp_attr_init(TpAttr *attr) {
+	memset(attr, 0, sizeof(TpAttr));
+}
+
 /**
  * member function reality. thread pool init function.
  * para:
  * 	pTp: thread pool struct instance ponter
  * return:
- * 	true: successful; false: failed
+ * 	0: successful; -1: failed, the pool is still to be freed by tp_close()
  */
 static int tp_init(TpThreadPool *pTp) {
 	int err;
     unsigned i;
 	TpThreadInfo *pThi;
+	pthread_attr_t attr;
 
 	//init_queue(&pTp->idle_q, NULL);
-	pTp->busy_q = ts_queue_create();
-	pTp->idle_q = ts_queue_create();
+	pTp->idle_q = (TSRing **) calloc(pTp->node_num, sizeof(TSRing *));
+	for (i = 0; i < pTp->node_num; i++)
+		pTp->idle_q[i] = ts_ring_create(pTp->max_th_num);
+	//thread infos of a node come from pages of the node, a few of them
+	//share a page instead of one each
+	pTp->info_slab = (TSSlab **) calloc(pTp->node_num, sizeof(TSSlab *));
+	for (i = 0; i < pTp->node_num; i++)
+		pTp->info_slab[i] = ts_slab_create_ex(sizeof(TpThreadInfo), pTp->max_th_num / pTp->node_num + 1,
+				0, 0, tp_node_alloc, pTp->node_id ? &pTp->node_id[i] : NULL);
 	pTp->busy_threshold = BUSY_THRESHOLD;
 	pTp->manage_interval = MANAGE_INTERVAL;
+	pTp->sample_interval = SAMPLE_INTERVAL;
+	pTp->retired = NULL;
+	pTp->shutdown = FALSE;
+	pTp->dispatching = 0;
+	pTp->refs = 1;
+	pTp->timer = NULL;
+	pTp->reserve = TP_RESERVE;
+	pTp->spawn_nr = 0;
+	pTp->manage_next = pTp->manage_window = tp_now_ms();
+	pTp->busy_last = 0;
+	pTp->pending_last = 0;
+	pTp->idle_low = ~0U;
+	pTp->group = NULL;
+	pTp->group_next = NULL;
+	pTp->weight = pTp->attr.weight ? pTp->attr.weight : 1;
+	pTp->shed_nr = 0;
+	pTp->shed_q = NULL;
+	//spinning only delays the poster on a single cpu
+	pTp->spin_count = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? TP_SPIN_COUNT : 0;
+
+	pthread_mutex_init(&pTp->job_lock, NULL);
+	pthread_cond_init(&pTp->job_cond, NULL);
+	if (tp_set_policy(pTp, pTp->attr.policy, pTp->attr.overflow_fun, pTp->attr.overflow_arg) != 0)
+		tp_set_policy(pTp, TP_POLICY_REJECT, NULL, NULL);
+	pTp->blocked = 0;
+	pTp->caller_runs = 0;
+	pTp->dropped = 0;
+	pTp->overflowed = 0;
+	pTp->job_num = 0;
+	pTp->job_capacity = JOB_QUEUE_CAPACITY;
+	pTp->prio_weight[TP_PRIO_HIGH] = TP_PRIO_WEIGHT_HIGH;
+	pTp->prio_weight[TP_PRIO_NORMAL] = TP_PRIO_WEIGHT_NORMAL;
+	pTp->prio_weight[TP_PRIO_LOW] = TP_PRIO_WEIGHT_LOW;
+	for (i = 0; i < TP_PRIO_NUM; i++) {
+		pTp->job_head[i] = pTp->job_tail[i] = NULL;
+		pTp->prio_credit[i] = pTp->prio_weight[i];
+		memset(&pTp->prio_stats[i], 0, sizeof(TpPrioStats));
+	}
+	pTp->job_slab = ts_slab_create(sizeof(TpJob), TP_SLAB_CHUNK, pTp->max_th_num, TP_SLAB_CACHE);
+
+	pthread_mutex_init(&pTp->slot_lock, NULL);
+	pTp->slot_th = (TpThreadInfo **) calloc(pTp->max_th_num, sizeof(TpThreadInfo *));
+	pTp->local_q = (WSDeque **) calloc(pTp->max_th_num, sizeof(WSDeque *));
+	pTp->local_num = 0;
+	if (posix_memalign((void **) &pTp->slot_stats, TS_CACHE_LINE, pTp->max_th_num * sizeof(TpWorkerSlot)) == 0)
+		memset(pTp->slot_stats, 0, pTp->max_th_num * sizeof(TpWorkerSlot));
+	pTp->th_created = 0;
+	pTp->th_destroyed = 0;
+	pTp->timing = FALSE;
+	pTp->slot_hist = NULL;
+	pTp->tracing = FALSE;
+	pTp->trace = NULL;
+	pTp->th_num = 0;
+	pTp->busy_nr = 0;
+	pTp->idle_nr = 0;
+
+    //init manage thread info, stop_flag is set until the manage thread is
+	//running so tp_close() doesn't wait for it
+	pThi = (TpThreadInfo*) ts_slab_alloc(pTp->info_slab[0], TS_SLAB_SHARED);
+	pThi->tp_pool = pTp;
+	pThi->stop_flag = TRUE;
+	ts_event_init(&pThi->event);
+	pThi->spin = 0;
+	pThi->proc_fun = NULL;
+	pThi->arg = NULL;
+	pThi->local_q = NULL;
+	pTp->manage = pThi;
 
 	//create work thread and init work thread info
 	for (i = 0; i < pTp->min_th_num; i++) {
-        pThi = (TpThreadInfo*) malloc(sizeof(TpThreadInfo));
-		pThi->tp_pool = pTp;
-		pThi->stop_flag = FALSE;
-        pThi->event_sem = (sem_t*)malloc(sizeof(sem_t));
-		sem_init(pThi->event_sem, 0, 0);
-		pThi->proc_fun = NULL;
-		pThi->arg = NULL;
-		ts_queue_enq_data(pTp->idle_q, pThi);
-
-		err = pthread_create(&pThi->thread_id, NULL, tp_work_thread, pThi);
-		if (0 != err) {
-			perror("tp_init: create work thread failed.");
-			ts_queue_destroy(pTp->busy_q);
-            ts_queue_destroy(pTp->idle_q);
+		if (!tp_add_thread(pTp, TRUE)) {
+			fprintf(stderr, "tp_init: create work thread failed.\n");
 			return -1;
 		}
 	}
 
-    //create manage thread and init manage thread info
-	pThi = (TpThreadInfo*) malloc(sizeof(TpThreadInfo));
-	pThi->tp_pool = pTp;
-	pThi->stop_flag = FALSE;
-    pThi->event_sem = (sem_t*)malloc(sizeof(sem_t));
-	sem_init(pThi->event_sem, 0, 0);
-	pThi->proc_fun = NULL;
-	pThi->arg = NULL;
+	//managed by the group manager, no manage thread of its own. the pool
+	//manages itself if it can't join
+	if (pTp->attr.group) {
+		pTp->shed_q = ts_ring_create(pTp->max_th_num);
+		if (tp_group_join(pTp->attr.group, pTp) == 0)
+			return 0;
+	}
     
-	err = pthread_create(&pThi->thread_id, NULL, tp_manage_thread, pThi);
+    //create manage thread
+	pThi->stop_flag = FALSE;
+	tp_thread_attr(pTp, NULL, &attr);
+	err = pthread_create(&pThi->thread_id, &attr, tp_manage_thread, pThi);
+	pthread_attr_destroy(&attr);
 	if (0 != err) {//clear_queue(&pTp->idle_q);
-	    ts_queue_destroy(pTp->busy_q);
-		ts_queue_destroy(pTp->idle_q);
+		pThi->stop_flag = TRUE;
 		fprintf(stderr, "tp_init: creat manage thread failed\n");
-		return 0;
+		return -1;
 	}
-    pTp->manage = pThi;
 
     #if 0
 	//wait for all threads are ready
@@ -133,314 +311,2380 @@ static int tp_init(TpThreadPool *pTp) {
 }
 
 /**
- * member function reality. thread pool entirely close function.
+ * member function reality. thread pool entirely close function. jobs queued
+ * are dropped, jobs running are done before their threads exit.
  * para:
  * 	pTp: thread pool struct instance ponter
+ * 	wait: wait for jobs running, otherwise threads are detached and the pool
+ * 		is freed by the last one exiting
  * return:
  */
 void tp_close(TpThreadPool *pTp, BOOL wait) {
+	tp_stop_accept(pTp);
+	tp_stop_threads(pTp, wait);
+	tp_release(pTp);
+}
+
+/**
+ * member function reality. stop accepting jobs and stop all threads, jobs
+ * submitted from now on get TP_ESHUTDOWN. the pool is still to be freed by
+ * tp_close().
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	mode: TP_SHUTDOWN_DRAIN - run all jobs queued, even ones queued by the
+ * 		jobs running
+ * 		TP_SHUTDOWN_TIMEOUT - same as TP_SHUTDOWN_DRAIN for timeout ms at
+ * 		most, then drop jobs left
+ * 		TP_SHUTDOWN_NOW - drop jobs queued
+ * 	timeout: in ms, for TP_SHUTDOWN_TIMEOUT only
+ * return:
+ * 	number of jobs dropped, their drop_fun is called; -1: failed or shut
+ * 	down already
+ */
+int tp_shutdown(TpThreadPool *pTp, unsigned mode, int timeout) {
+	unsigned long deadline;
+
+	if (!pTp || mode > TP_SHUTDOWN_NOW) return -1;
+
+	deadline = tp_now_ms() + (timeout > 0 ? timeout : 0);
+	if (tp_stop_accept(pTp))
+		return -1;
+
+	//threads and the manage thread keep working until all jobs are done
+	while (mode != TP_SHUTDOWN_NOW
+			&& (__atomic_load_n(&pTp->job_num, __ATOMIC_RELAXED)
+				|| __atomic_load_n(&pTp->busy_nr, __ATOMIC_RELAXED)
+				|| tp_local_job_num(pTp))) {
+		if (mode == TP_SHUTDOWN_TIMEOUT && tp_now_ms() >= deadline)
+			break;
+		usleep(TP_DRAIN_INTERVAL * 1000);
+	}
+	tp_stop_threads(pTp, TRUE);
+
+	//no thread is left, jobs not done are dropped here
+	return tp_drop_jobs(pTp);
+}
+
+/**
+ * internal interface. reject jobs from now on. submitters waiting for room in
+ * the pending job queue give up, the ones dispatching jobs queued before are
+ * waited for.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	TRUE: stopped before
+ */
+static BOOL tp_stop_accept(TpThreadPool *pTp) {
+	BOOL stopped;
+
+	pthread_mutex_lock(&pTp->job_lock);
+	stopped = pTp->shutdown;
+	pTp->shutdown = TRUE;
+	pthread_cond_broadcast(&pTp->job_cond);
+	pthread_mutex_unlock(&pTp->job_lock);
+
+	while (__atomic_load_n(&pTp->dispatching, __ATOMIC_ACQUIRE))
+		sched_yield();
+	return stopped;
+}
+
+/**
+ * internal interface. stop the manage thread and all work threads, jobs
+ * queued are kept.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	wait: join work threads, otherwise they're detached
+ * return:
+ */
+static void tp_stop_threads(TpThreadPool *pTp, BOOL wait) {
     TpThreadInfo *pThi;
     pthread_t thread_id;
+    unsigned i;
     
-	//close manage thread first
-    DEBUG("close manage thread\n");
-    thread_id = pTp->manage->thread_id; //:NOTE: get thread_id before post event
-    pTp->manage->stop_flag = TRUE;
-    sem_post(pTp->manage->event_sem);
-	pthread_join(thread_id, NULL);
-
-    DEBUG("total number of threads: %d\n", ts_queue_count(pTp->busy_q)+ts_queue_count(pTp->idle_q));
-	if (wait) {
-        while (!ts_queue_is_empty(pTp->busy_q)) {
-            pThi = (TpThreadInfo *)ts_queue_deq_data(pTp->busy_q);
-            thread_id = pThi->thread_id; //:NOTE: get thread_id before post event
-            pThi->stop_flag = TRUE;
-            sem_post(pThi->event_sem);
+	//timers can't queue jobs any more
+	tp_timer_stop(pTp);
+	//the group manager doesn't touch the pool any more
+	tp_group_leave(pTp);
 
-            DEBUG("join thread 0x%08x\n", (unsigned)thread_id);
-			if(0 != pthread_join(thread_id, NULL)){
-				perror("pthread_join");
-			}
-			//DEBUG("join a thread success.\n");
-        }
+	//close manage thread first, its thread info is freed with the pool
+	//since submitters may still post its event
+	if (!pTp->manage->stop_flag) {
+		DEBUG("close manage thread\n");
+		pTp->manage->stop_flag = TRUE;
+		ts_event_post(&pTp->manage->event);
+		pthread_join(pTp->manage->thread_id, NULL);
+	}
+	tp_reap_threads(pTp, TRUE);
 
-        while (!ts_queue_is_empty(pTp->idle_q)) {
-            pThi = (TpThreadInfo *)ts_queue_deq_data(pTp->idle_q);
-            thread_id = pThi->thread_id; //:NOTE: get thread_id before post event
-            pThi->stop_flag = TRUE;
-            sem_post(pThi->event_sem);
+    DEBUG("total number of threads: %d\n", pTp->th_num);
+	//idle_q is not touched here, every thread is found by its slot. the
+	//thread info is kept in the slot until the pool is freed
+	for (i = 0; i < pTp->max_th_num; i++) {
+		pThi = pTp->slot_th[i];
+		if (!pThi || pThi->stop_flag)
+			continue;
+		thread_id = pThi->thread_id; //:NOTE: get thread_id before post event
+		pThi->stop_flag = TRUE;
+		ts_event_post(&pThi->event);
 
+		if (wait) {
             DEBUG("join thread 0x%08x\n", (unsigned)thread_id);
 			if(0 != pthread_join(thread_id, NULL)){
 				perror("pthread_join");
 			}
-			//DEBUG("join a thread success.\n");
-        }
-
+		} else {
+			pthread_detach(thread_id);
+		}
+	}
+	if (wait) {
         DEBUG("join all thread success.\n");
-	} else {
-		//close work thread
-		while (!ts_queue_is_empty(pTp->busy_q)) {
-            pThi = (TpThreadInfo *)ts_queue_deq_data(pTp->busy_q);
-            pThi->stop_flag = TRUE;
-            sem_post(pThi->event_sem);
-        }
-        
-        while (!ts_queue_is_empty(pTp->idle_q)) {
-            pThi = (TpThreadInfo *)ts_queue_deq_data(pTp->idle_q);
-            pThi->stop_flag = TRUE;
-            sem_post(pThi->event_sem);
-        }
 	}
+}
+
+/**
+ * internal interface. drop jobs left in the pending job queue and local
+ * queues, no thread may fetch jobs meanwhile.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	number of jobs dropped
+ */
+static int tp_drop_jobs(TpThreadPool *pTp) {
+	TpJob *job;
+	unsigned i;
+	int n = 0;
+
+	pthread_mutex_lock(&pTp->job_lock);
+	for (i = 0; i < TP_PRIO_NUM; i++) {
+		while (pTp->job_head[i]) {
+			job = pTp->job_head[i];
+			pTp->job_head[i] = job->next;
+			tp_job_drop(job);
+			n++;
+		}
+		pTp->job_tail[i] = NULL;
+		pTp->prio_stats[i].queued = 0;
+	}
+	pTp->job_num = 0;
+	pthread_mutex_unlock(&pTp->job_lock);
+
+	for (i = 0; i < pTp->local_num; i++) {
+		while ((job = (TpJob *) ws_deque_steal(pTp->local_q[i])) != NULL) {
+			tp_job_drop(job);
+			n++;
+		}
+	}
+	return n;
+}
+
+/**
+ * internal interface. drop a reference of the pool, the last one frees it.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ */
+static void tp_release(TpThreadPool *pTp) {
+    unsigned i;
+
+	if (__atomic_sub_fetch(&pTp->refs, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+
+	//pending jobs not fetched by any thread are discarded
+	tp_drop_jobs(pTp);
+
+	//thread infos left are released with their slabs
+	for (i = 0; i < pTp->node_num; i++)
+		ts_slab_destroy(pTp->info_slab[i]);
+	free(pTp->info_slab);
+	ts_slab_destroy(pTp->job_slab);
+	ts_ring_destroy(pTp->shed_q);
 
 	//clear_queue(&pTp->idle_q);
-	ts_queue_destroy(pTp->busy_q);
-	ts_queue_destroy(pTp->idle_q);
+	tp_free_nodes(pTp);
+	pthread_cond_destroy(&pTp->job_cond);
+	pthread_mutex_destroy(&pTp->job_lock);
+
+	for (i = 0; i < pTp->local_num; i++)
+		ws_deque_destroy(pTp->local_q[i]);
+	free(pTp->local_q);
+	free(pTp->slot_th);
+	free(pTp->slot_stats);
+	free(pTp->slot_hist);
+	free(pTp->trace);
+	tp_timer_destroy(pTp);
+	pthread_mutex_destroy(&pTp->slot_lock);
     free(pTp);
 }
 
 /**
  * member function reality. main interface opened.
  * after getting own worker and job, user may use the function to process the task.
+ * the job is queued and an idle thread is woken up to fetch it, if all threads
+ * are busy the job waits in the queue until a thread finishes its current job.
  * para:
  * 	pTp: thread pool struct instance ponter
  *	worker: user task reality.
  *	job: user task para
  * return:
+ * 	0: successful, or taken by the saturation policy; -1: the pending job queue
+ * 	is full and the policy rejects it;
+ * 	TP_ESHUTDOWN: the pool is shutting down
  */
 int tp_process_job(TpThreadPool *pTp, process_job proc_fun, void *arg) {
-	TpThreadInfo *pThi ;
+	return tp_process_job_timed(pTp, proc_fun, arg, 0);
+}
 
-    if (!pTp || !proc_fun) return -1;
-    
-	pThi = (TpThreadInfo *) ts_queue_deq_data(pTp->idle_q);
-	if(pThi){
-		DEBUG("Fetch a thread from pool.\n");
-		pThi->proc_fun = proc_fun;
-		pThi->arg = arg;
-        ts_queue_enq_data(pTp->busy_q, pThi);
-        
-		//let the thread to deal with this job
-		DEBUG("wake up thread %u\n", (unsigned)pThi->thread_id);
-        sem_post(pThi->event_sem);
-	}
-	else{
-		//if all current thread are busy, new thread is created here
-		if(!(pThi = tp_add_thread(pTp, proc_fun, arg))){
-			DEBUG("The thread pool is full, no more thread available.\n");
-			return -1;
-		}
-		/* should I wait? */
-		//pthread_mutex_lock(&pTp->tp_lock);
-		//pthread_cond_wait(&pTp->tp_cond, &pTp->tp_lock);
-		//pthread_mutex_unlock(&pTp->tp_lock);
-		
-		DEBUG("No more idle thread, create a new thread\n");
-	}
-	return 0;
+/**
+ * member function reality. same as tp_process_job(), but wait for a free slot
+ * in the pending job queue if it's full.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ *	worker: user task reality.
+ *	job: user task para
+ *	timeout: wait time in ms, 0 - don't wait, TP_WAIT_FOREVER - wait until queued
+ * return:
+ * 	0: successful, or taken by the saturation policy; -1: the pending job queue
+ * 	is full after timeout and the policy rejects it;
+ * 	TP_ESHUTDOWN: the pool is shutting down
+ */
+int tp_process_job_timed(TpThreadPool *pTp, process_job proc_fun, void *arg, int timeout) {
+	return tp_process_job_prio(pTp, proc_fun, arg, TP_PRIO_NORMAL, timeout);
 }
 
 /**
- * member function reality. add new thread into the pool and run immediately.
+ * member function reality. same as tp_process_job_timed(), with a priority.
+ * jobs of each priority have their own pending queue, work threads fetch
+ * them by the weight of each priority.
  * para:
  * 	pTp: thread pool struct instance ponter
- * 	proc_fun:
- * 	job:
+ *	worker: user task reality.
+ *	job: user task para
+ *	prio: TP_PRIO_HIGH, TP_PRIO_NORMAL or TP_PRIO_LOW
+ *	timeout: same as tp_process_job_timed()
  * return:
- * 	pointer of TpThreadInfo
+ * 	0: successful; -1: the pending job queue is full after timeout;
+ * 	TP_ESHUTDOWN: the pool is shutting down
  */
-static TpThreadInfo *tp_add_thread(TpThreadPool *pTp, process_job proc_fun, void *arg) {
+int tp_process_job_prio(TpThreadPool *pTp, process_job proc_fun, void *arg, unsigned prio, int timeout) {
+	TpJob *job;
 	int err;
-	TpThreadInfo *pThi;
-
-	if (pTp->max_th_num <= ts_queue_count(pTp->busy_q)+ts_queue_count(pTp->idle_q)){
-		return NULL;
-	}
-    
-	//malloc new thread info struct
-	pThi = (TpThreadInfo*) malloc(sizeof(TpThreadInfo));
 
-	//init status, queue into busy_q, only new process job will call this function
-	pThi->tp_pool = pTp;
-	pThi->stop_flag = FALSE;
-	pThi->event_sem = (sem_t*)malloc(sizeof(sem_t));
-	sem_init(pThi->event_sem, 0, 0);
-	pThi->proc_fun = proc_fun;
-	pThi->arg = arg;
-    ts_queue_enq_data(pTp->busy_q, pThi);
+    if (!pTp || !proc_fun || prio >= TP_PRIO_NUM) return -1;
 
-	err = pthread_create(&pThi->thread_id, NULL, tp_work_thread, pThi);
-	if (0 != err) {
-		perror("tp_add_thread: pthread_create");
-        ts_queue_rm_data(pTp->busy_q, pThi);
-        sem_destroy(pThi->event_sem);
-        free(pThi->event_sem);
-		free(pThi);
-		return NULL;
-	}
+	job = tp_job_create_ex(pTp, proc_fun, NULL, 0);
+	if (!job) return -1;
+	job->arg = arg;
+	job->prio = prio;
 
-    sem_post(pThi->event_sem);
-	return pThi;
+	err = tp_process_job_ex(pTp, job, timeout);
+	if (err != 0)
+		tp_job_destroy(job);
+	return err;
 }
 
 /**
- * member function reality. delete idle thread in the pool.
- * only delete last idle thread in the pool.
+ * member function reality. same as tp_process_job_timed(), the job is dropped
+ * without running if c is cancelled or deadline is passed before it starts.
  * para:
  * 	pTp: thread pool struct instance ponter
+ *	worker: user task reality.
+ *	job: user task para
+ *	c: cancellation token, NULL - none
+ *	deadline: CLOCK_MONOTONIC, NULL - none
+ *	timeout: same as tp_process_job_timed()
  * return:
- * 	true: successful; false: failed
+ * 	0: successful; -1: the pending job queue is full after timeout;
+ * 	TP_ESHUTDOWN: the pool is shutting down
  */
-int tp_delete_thread(TpThreadPool *pTp) {
-    TpThreadInfo *pThi;
-    pthread_t thread_id;
+int tp_process_job_cancel(TpThreadPool *pTp, process_job proc_fun, void *arg, TpCancel *c, const struct timespec *deadline, int timeout) {
+	TpJob *job;
+	int err;
 
-	//current thread num can't < min thread num
-	if (ts_queue_count(pTp->busy_q)+ts_queue_count(pTp->idle_q) <= pTp->min_th_num)
-		return -1;
-	//all threads are busy
-	pThi = (TpThreadInfo *) ts_queue_deq_data(pTp->idle_q);
-	if(!pThi)
-		return -1;
-	
-    DEBUG("Delete idle thread 0x%08x\n", (unsigned)pThi->thread_id);
-    //close the idle thread
-    thread_id = pThi->thread_id; //:NOTE: get thread_id before post event
-    pThi->stop_flag = TRUE;
-    sem_post(pThi->event_sem);
-    pthread_join(thread_id, NULL);
+    if (!pTp || !proc_fun) return -1;
 
-	return 0;
+	job = tp_job_create_ex(pTp, proc_fun, NULL, 0);
+	if (!job) return -1;
+	job->arg = arg;
+	tp_job_set_cancel(job, c);
+	tp_job_set_deadline(job, deadline);
+
+	err = tp_process_job_ex(pTp, job, timeout);
+	if (err != 0)
+		tp_job_destroy(job);
+	return err;
 }
 
 /**
- * internal interface. real work thread.
- * @params:
- * 	arg: args for this method
- * @return:
- *	none
+ * member function reality. create a job, the job data is kept in the job
+ * itself if it's not bigger than TP_JOB_DATA_SIZE, otherwise it's allocated
+ * together with the job, so no other allocation is needed for the job data.
+ * para:
+ *	proc_fun: user task reality, called with job->arg
+ *	drop_fun: called with job->arg if the job is discarded without running, may be NULL
+ *	data_size: size of job data, job->arg points to it. if 0, job->arg is
+ *		set by the caller
+ * return:
+ * 	the job, NULL if failed
  */
-static void *tp_work_thread(void *arg) {
-	TpThreadInfo *pThi = (TpThreadInfo *) arg;
-	TpThreadPool *pTp = pThi->tp_pool;
-
-#if 0
-	//wake up waiting thread, notify it I am ready
-	pthread_cond_signal(&pTp->tp_cond);
-#endif
+TpJob *tp_job_create(process_job proc_fun, process_job drop_fun, size_t data_size) {
+	return tp_job_create_ex(NULL, proc_fun, drop_fun, data_size);
+}
 
-    while (1) {
-		//wait event for processing real job.
-        sem_wait(pThi->event_sem);
+/**
+ * member function reality. same as tp_job_create(), but the job is allocated
+ * from the job slab of the pool if its data fits in, without locking when
+ * called by a work thread. the job must be queued to pTp or destroyed before
+ * the pool is closed.
+ * para:
+ * 	pTp: thread pool struct instance ponter, NULL - same as tp_job_create()
+ *	proc_fun: user task reality, called with job->arg
+ *	drop_fun: called with job->arg if the job is discarded without running, may be NULL
+ *	data_size: size of job data
+ * return:
+ * 	the job, NULL if failed
+ */
+TpJob *tp_job_create_ex(TpThreadPool *pTp, process_job proc_fun, process_job drop_fun, size_t data_size) {
+	TpJob *job;
+	size_t size = sizeof(TpJob);
 
-        //process
-		if(pThi->proc_fun){
-			DEBUG("thread 0x%08x is running\n", (unsigned)pThi->thread_id);
-			pThi->proc_fun(pThi->arg);
-			//thread state should be set idle after work
-			pThi->proc_fun = NULL;
-            //pThi->arg = NULL;
-		}
+	if (!proc_fun) return NULL;
+	if (pTp && pTp->job_slab && data_size <= TP_JOB_DATA_SIZE) {
+		job = (TpJob *) ts_slab_alloc(pTp->job_slab, tp_slab_cache(pTp));
+		if (!job) return NULL;
+		job->tp_pool = pTp;
+	} else {
+		if (data_size > TP_JOB_DATA_SIZE)
+			size += data_size - TP_JOB_DATA_SIZE;
+		job = (TpJob *) malloc(size);
+		if (!job) return NULL;
+		job->tp_pool = NULL;
+	}
+	job->proc_fun = proc_fun;
+	job->drop_fun = drop_fun;
+	job->arg = data_size ? job->u.data : NULL;
+	job->next = NULL;
+	job->prio = TP_PRIO_NORMAL;
+	job->submit_ns = 0;
+	job->cancel = NULL;
+	job->deadline_ns = 0;
+	return job;
+}
 
-        //stop
-		if(pThi->stop_flag){
-			DEBUG("thread 0x%08x stop\n", (unsigned)pThi->thread_id);
-			break;
-		}
+/**
+ * member function reality. free a job created by tp_job_create(), the job
+ * data is not touched. a job queued successfully is freed by the pool.
+ * para:
+ *	job: the job
+ * return:
+ */
+void tp_job_destroy(TpJob *job) {
+	tp_cancel_free(job->cancel);
+	if (job->tp_pool)
+		ts_slab_free(job->tp_pool->job_slab, job, tp_slab_cache(job->tp_pool));
+	else
+		free(job);
+}
 
-        //work thread is idle now, we must check stop_flag before
-        //accessing pTp in case of pTp already freed by tp_close()
-		if (ts_queue_rm_data(pTp->busy_q, pThi) != NULL) {
-		    ts_queue_enq_data(pTp->idle_q, pThi);
-		}            
-	}
+/**
+ * member function reality. create a cancellation token, jobs holding it are
+ * dropped without running once it's cancelled. the token is released by
+ * tp_cancel_free(), jobs keep their own reference.
+ * return:
+ * 	the token, NULL if failed
+ */
+TpCancel *tp_cancel_create(void) {
+	TpCancel *c = (TpCancel *) malloc(sizeof(TpCancel));
 
-    DEBUG("thread 0x%08x exit\n", (unsigned)pThi->thread_id);
-    sem_destroy(pThi->event_sem);
-    free(pThi->event_sem);
-    free(pThi);
-    return NULL;
+	if (!c) return NULL;
+	c->cancelled = FALSE;
+	c->refs = 1;
+	return c;
 }
 
 /**
- * member function reality. get current thread pool status:idle, normal, busy, .etc.
+ * member function reality. cancel all jobs holding the token, jobs queued
+ * are dropped when fetched, jobs running may check tp_cancelled() or
+ * tp_job_cancelled() to stop early.
  * para:
- * 	pTp: thread pool struct instance ponter
+ * 	c: the token
  * return:
- * 	0: idle; 1: normal or busy(don't process)
  */
-int tp_get_tp_status(TpThreadPool *pTp) {
-    float busy_rate = 0.0;
-    unsigned busy_nr, idle_nr;
+void tp_cancel(TpCancel *c) {
+	if (c)
+		__atomic_store_n(&c->cancelled, TRUE, __ATOMIC_RELEASE);
+}
 
-    //get busy thread number
-    busy_nr = ts_queue_count(pTp->busy_q);
-    idle_nr = ts_queue_count(pTp->idle_q);
-    busy_rate = busy_nr;
-    busy_rate = busy_rate / (busy_nr+idle_nr);
+BOOL tp_cancelled(const TpCancel *c) {
+	return c && __atomic_load_n(&c->cancelled, __ATOMIC_ACQUIRE);
+}
 
-    DEBUG("Thread pool status, total num: %d, busy num: %d, idle num: %d\n", \
-          (busy_nr+idle_nr), busy_nr, idle_nr);
-    if (busy_rate < pTp->busy_threshold)
-        return 0;//idle status
-    else
-        return 1;//busy or normal status
+void tp_cancel_free(TpCancel *c) {
+	if (c && __atomic_sub_fetch(&c->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		free(c);
 }
 
 /**
- * internal interface. manage thread pool to delete idle thread.
+ * member function reality. let the job hold a cancellation token, a job
+ * holds one token at most.
  * para:
- * 	pthread: thread struct ponter
+ *	job: the job, not queued yet
+ *	c: the token, NULL - none
  * return:
  */
-static void *tp_manage_thread(void *arg) {
-	TpThreadInfo *pThi = (TpThreadInfo *) arg;
-	TpThreadPool *pTp = pThi->tp_pool;
+void tp_job_set_cancel(TpJob *job, TpCancel *c) {
+	if (c)
+		__atomic_add_fetch(&c->refs, 1, __ATOMIC_RELAXED);
+	tp_cancel_free(job->cancel);
+	job->cancel = c;
+}
 
-    while (1) {
-        struct timespec abs_timeout;
-    	afterms(&abs_timeout, pTp->manage_interval*1000);
-        sem_timedwait(pThi->event_sem, &abs_timeout);
-    
-		if(pThi->stop_flag){
-			break;
-		}
+/**
+ * member function reality. drop the job without running if it's not started
+ * by the deadline.
+ * para:
+ *	job: the job, not queued yet
+ *	abstime: the deadline, CLOCK_MONOTONIC, NULL - none
+ * return:
+ */
+void tp_job_set_deadline(TpJob *job, const struct timespec *abstime) {
+	job->deadline_ns = abstime ? abstime->tv_sec * 1000000000ULL + abstime->tv_nsec : 0;
+}
 
-        if (tp_get_tp_status(pTp) == 0) {
-            tp_delete_thread(pTp);
-		}
-    }
+/**
+ * member function reality. check if the job running on the calling thread is
+ * cancelled or past its deadline. it's cheap enough to be polled in loops.
+ * return:
+ * 	TRUE: the job should stop; FALSE: go on, or not called by a job
+ */
+BOOL tp_job_cancelled(void) {
+	TpThreadInfo *pThi = tp_self;
 
-    DEBUG("manage thread 0x%08x exit\n", (unsigned)pThi->thread_id);
-    sem_destroy(pThi->event_sem);
-    free(pThi->event_sem);
-    free(pThi);
-	return NULL;
+	return pThi && pThi->job && tp_job_expired(pThi->job);
 }
 
-float tp_get_busy_threshold(TpThreadPool *pTp){
-	return pTp->busy_threshold;
+/**
+ * internal interface. check if a job is cancelled or past its deadline.
+ */
+static BOOL tp_job_expired(TpJob *job) {
+	if (job->cancel && __atomic_load_n(&job->cancel->cancelled, __ATOMIC_ACQUIRE))
+		return TRUE;
+	return job->deadline_ns && tp_now_ns() >= job->deadline_ns;
 }
 
-int tp_set_busy_threshold(TpThreadPool *pTp, float bt){
-	if(bt <= 1.0 && bt > 0.) {
-		pTp->busy_threshold = bt;
-        return 0;
-	}
-
-    return -1;
+/**
+ * internal interface. discard a job without running it.
+ */
+static void tp_job_drop(TpJob *job) {
+	if (job->drop_fun)
+		job->drop_fun(job->arg);
+	tp_job_destroy(job);
 }
 
-unsigned tp_get_manage_interval(TpThreadPool *pTp){
-	return pTp->manage_interval;
+/**
+ * internal interface. run a job by the submitting thread under
+ * TP_POLICY_CALLER_RUNS, a job cancelled or past its deadline is dropped.
+ */
+static void tp_job_run(TpJob *job) {
+	TpThreadInfo *pThi = tp_self;
+	TpJob *outer = NULL;
+
+	if ((job->cancel || job->deadline_ns) && tp_job_expired(job)) {
+		tp_job_drop(job);
+		return;
+	}
+	//tp_job_cancelled() sees this job while it runs
+	if (pThi) {
+		outer = pThi->job;
+		pThi->job = job;
+	}
+	job->proc_fun(job->arg);
+	if (pThi)
+		pThi->job = outer;
+	tp_job_destroy(job);
 }
 
-int tp_set_manage_interval(TpThreadPool *pTp, unsigned mi){
-	pTp->manage_interval = mi;
+/**
+ * member function reality. queue a job created by tp_job_create().
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ *	job: the job, owned by the pool if successful
+ *	timeout: same as tp_process_job_timed()
+ * return:
+ * 	0: successful; -1: the pending job queue is full after timeout;
+ * 	TP_ESHUTDOWN: the pool is shutting down
+ */
+int tp_process_job_ex(TpThreadPool *pTp, TpJob *job, int timeout) {
+	int n = tp_process_jobs_ex(pTp, &job, 1, timeout);
+
+	return n == 1 ? 0 : n == TP_ESHUTDOWN ? TP_ESHUTDOWN : -1;
+}
+
+/**
+ * member function reality. process a batch of jobs with the same proc_fun,
+ * jobs are queued with a few locking and threads are woken up in proportion to
+ * the batch size rather than once per job.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ *	proc_fun: user task reality.
+ *	args: user task para of each job
+ *	n: number of jobs
+ * return:
+ * 	number of jobs queued, less than n if the pending job queue is full;
+ * 	-1: failed
+ */
+int tp_process_jobs(TpThreadPool *pTp, process_job proc_fun, void **args, unsigned n) {
+	return tp_process_jobs_timed(pTp, proc_fun, args, n, 0);
+}
+
+/**
+ * member function reality. same as tp_process_jobs(), but wait for free slots
+ * in the pending job queue if it's full.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ *	proc_fun: user task reality.
+ *	args: user task para of each job
+ *	n: number of jobs
+ *	timeout: same as tp_process_job_timed()
+ * return:
+ * 	number of jobs queued; -1: failed;
+ * 	TP_ESHUTDOWN: the pool is shutting down
+ */
+int tp_process_jobs_timed(TpThreadPool *pTp, process_job proc_fun, void **args, unsigned n, int timeout) {
+	TpJob *jobs[TP_BATCH_SIZE];
+	unsigned i, k, m, done = 0;
+	int queued;
+
+    if (!pTp || !proc_fun || (!args && n)) return -1;
+
+	while (done < n) {
+		m = n - done < TP_BATCH_SIZE ? n - done : TP_BATCH_SIZE;
+		for (k = 0; k < m; k++) {
+			jobs[k] = tp_job_create_ex(pTp, proc_fun, NULL, 0);
+			if (!jobs[k]) break;
+			jobs[k]->arg = args[done + k];
+		}
+
+		queued = tp_process_jobs_ex(pTp, jobs, k, timeout);
+		if (queued == TP_ESHUTDOWN && !done) {
+			for (i = 0; i < k; i++)
+				tp_job_destroy(jobs[i]);
+			return TP_ESHUTDOWN;
+		}
+		if (queued < 0) queued = 0;
+		for (i = queued; i < k; i++)
+			tp_job_destroy(jobs[i]);
+		done += queued;
+		if ((unsigned)queued < m) break;
+	}
+	return done;
+}
+
+/**
+ * member function reality. queue a batch of jobs created by tp_job_create().
+ * a job still finding its pending queue full after timeout is handled by the
+ * saturation policy of the pool, see tp_set_policy().
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ *	jobs: the jobs, the ones queued are owned by the pool
+ *	n: number of jobs
+ *	timeout: same as tp_process_job_timed()
+ * return:
+ * 	number of jobs queued, or run and taken by the saturation policy, jobs[0]
+ * 	to jobs[ret-1] are owned by the pool; -1: failed;
+ * 	TP_ESHUTDOWN: the pool is shutting down
+ */
+int tp_process_jobs_ex(TpThreadPool *pTp, TpJob **jobs, unsigned n, int timeout) {
+	TpThreadInfo *pThi;
+	TpJob *dropped, **dropped_tail, *old;
+	struct timespec abs_timeout;
+	unsigned i = 0, m, policy;
+	overflow_job overflow_fun;
+	void *overflow_arg;
+	BOOL waited = FALSE;
+	int err = 0, wait;
+
+    if (!pTp || (!jobs && n)) return -1;
+	if (__atomic_load_n(&pTp->shutdown, __ATOMIC_RELAXED)) return TP_ESHUTDOWN;
+
+	for (m = 0; m < n; m++) {
+		if (jobs[m]->prio >= TP_PRIO_NUM) return -1;
+	}
+	if (__atomic_load_n(&pTp->timing, __ATOMIC_ACQUIRE)) {
+		unsigned long long now = tp_now_ns();
+		for (m = 0; m < n; m++)
+			jobs[m]->submit_ns = now;
+	}
+
+	//jobs submitted by a work thread of this pool go to its local queue
+	//without any lock, idle threads steal them from there. jobs of other
+	//priorities go to the pending queue to be fetched by their weight
+	pThi = tp_self;
+	if (pThi && pThi->tp_pool == pTp) {
+		while (i < n && jobs[i]->prio == TP_PRIO_NORMAL
+				&& ws_deque_push(pThi->local_q, jobs[i]) == 0)
+			i++;
+		if (i) {
+			TpWorkerStats *st = &pTp->slot_stats[pThi->idx].s;
+			__atomic_store_n(&st->submitted, st->submitted + i, __ATOMIC_RELAXED);
+			tp_trace(pTp, TP_EV_SUBMIT, i);
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			for (m = 0; m < i && tp_wake_thread(pTp); m++)
+				;
+		}
+		if (i == n) return n;
+	}
+
+	if (timeout > 0) afterms(&abs_timeout, timeout);
+
+	while (i < n) {
+		err = 0;
+		dropped = NULL;
+		dropped_tail = &dropped;
+		pthread_mutex_lock(&pTp->job_lock);
+		policy = pTp->policy;
+		wait = policy == TP_POLICY_BLOCK && !timeout ? TP_WAIT_FOREVER : timeout;
+		//a work thread of the pool never waits for room, whatever the
+		//timeout, it may be the one to make it. it runs the job instead
+		if (wait && pThi && pThi->tp_pool == pTp) {
+			policy = TP_POLICY_CALLER_RUNS;
+			wait = 0;
+		}
+		overflow_fun = pTp->overflow_fun;
+		overflow_arg = pTp->overflow_arg;
+		while (!pTp->shutdown && pTp->prio_stats[jobs[i]->prio].queued >= pTp->job_capacity) {
+			if (wait == 0) {
+				err = -1;
+				break;
+			}
+			if (!waited) {
+				waited = TRUE;
+				__atomic_add_fetch(&pTp->blocked, 1, __ATOMIC_RELAXED);
+			}
+			if (wait < 0)
+				err = pthread_cond_wait(&pTp->job_cond, &pTp->job_lock);
+			else
+				err = pthread_cond_timedwait(&pTp->job_cond, &pTp->job_lock, &abs_timeout);
+			if (err) break;
+		}
+		if (pTp->shutdown)
+			err = TP_ESHUTDOWN;
+
+		//append as many jobs as the queue can hold at once. once the timeout
+		//is over, TP_POLICY_DROP_OLDEST makes room by the oldest job
+		m = 0;
+		while (err != TP_ESHUTDOWN && i < n) {
+			TpJob *job = jobs[i];
+			TpPrioStats *st = &pTp->prio_stats[job->prio];
+			if (st->queued >= pTp->job_capacity) {
+				if (!err || policy != TP_POLICY_DROP_OLDEST)
+					break;
+				old = pTp->job_head[job->prio];
+				pTp->job_head[job->prio] = old->next;
+				if (!old->next)
+					pTp->job_tail[job->prio] = NULL;
+				//dropped in the order they were queued
+				old->next = NULL;
+				*dropped_tail = old;
+				dropped_tail = &old->next;
+				__atomic_sub_fetch(&st->queued, 1, __ATOMIC_RELAXED);
+				__atomic_sub_fetch(&pTp->job_num, 1, __ATOMIC_RELAXED);
+				__atomic_add_fetch(&pTp->dropped, 1, __ATOMIC_RELAXED);
+			}
+			job->next = NULL;
+			if (pTp->job_tail[job->prio])
+				pTp->job_tail[job->prio]->next = job;
+			else
+				pTp->job_head[job->prio] = job;
+			pTp->job_tail[job->prio] = job;
+			__atomic_add_fetch(&st->queued, 1, __ATOMIC_RELAXED);
+			st->submitted++;
+			i++;
+			m++;
+		}
+		if (i == n)
+			err = 0;
+		if (err && err != TP_ESHUTDOWN && policy != TP_POLICY_CALLER_RUNS && policy != TP_POLICY_CALLBACK)
+			pTp->prio_stats[jobs[i]->prio].rejected += n - i;
+		__atomic_add_fetch(&pTp->job_num, m, __ATOMIC_RELAXED);
+		//tp_stop_accept() waits until the jobs are dispatched
+		__atomic_add_fetch(&pTp->dispatching, 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&pTp->job_lock);
+		if (m)
+			tp_trace(pTp, TP_EV_SUBMIT, m);
+
+		//let the threads deal with the jobs before waiting for more room
+		if (m || err != TP_ESHUTDOWN)
+			tp_dispatch(pTp, m);
+		__atomic_sub_fetch(&pTp->dispatching, 1, __ATOMIC_RELEASE);
+		while ((old = dropped) != NULL) {
+			dropped = old->next;
+			tp_job_drop(old);
+		}
+		if (!err)
+			continue;
+		if (err == TP_ESHUTDOWN)
+			break;
+
+		//the queue is full after timeout
+		if (policy == TP_POLICY_CALLER_RUNS) {
+			//the submitter is held up by the job, that's the backpressure
+			__atomic_add_fetch(&pTp->caller_runs, 1, __ATOMIC_RELAXED);
+			tp_job_run(jobs[i++]);
+			continue;
+		}
+		if (policy == TP_POLICY_CALLBACK) {
+			if (overflow_fun(pTp, jobs[i], overflow_arg) == 0) {
+				__atomic_add_fetch(&pTp->overflowed, 1, __ATOMIC_RELAXED);
+				tp_job_destroy(jobs[i++]);
+				continue;
+			}
+			pthread_mutex_lock(&pTp->job_lock);
+			pTp->prio_stats[jobs[i]->prio].rejected += n - i;
+			pthread_mutex_unlock(&pTp->job_lock);
+		}
+		DEBUG("The pending job queue is full.\n");
+		break;
+	}
+
+	return !i && err == TP_ESHUTDOWN ? TP_ESHUTDOWN : (int) i;
+}
+
+/**
+ * internal interface. let threads fetch n newly queued jobs, idle threads are
+ * woken up first, then the manage thread is asked to create new threads, the
+ * caller never waits for thread creation. if all threads are busy, the jobs
+ * are fetched when some of them are done.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	n: number of jobs
+ * return:
+ */
+static void tp_dispatch(TpThreadPool *pTp, unsigned n) {
+	while (n && tp_wake_thread(pTp)) {
+		DEBUG("wake up an idle thread\n");
+		n--;
+	}
+	if (n && __atomic_load_n(&pTp->th_num, __ATOMIC_RELAXED) < pTp->max_th_num && tp_group_room(pTp)) {
+		DEBUG("No more idle thread, create new threads\n");
+		__atomic_add_fetch(&pTp->spawn_nr, n, __ATOMIC_RELAXED);
+		tp_post_manage(pTp);
+	} else if (__atomic_load_n(&pTp->idle_nr, __ATOMIC_RELAXED) < __atomic_load_n(&pTp->reserve, __ATOMIC_RELAXED)) {
+		//refill the reserve
+		tp_post_manage(pTp);
+	}
+}
+
+/**
+ * member function reality. submit a job and get a future to wait for its
+ * result. the future must be released by tp_future_free().
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ *	proc_fun: user task reality, its return value is the result of the future
+ *	arg: user task para
+ *	timeout: same as tp_process_job_timed()
+ * return:
+ * 	the future, NULL if the job can't be queued
+ */
+TpFuture *tp_process_future(TpThreadPool *pTp, future_job proc_fun, void *arg, int timeout) {
+	TpFuture *f;
+	TpJob *job;
+
+	if (!pTp || !proc_fun) return NULL;
+
+	f = (TpFuture *) malloc(sizeof(TpFuture));
+	if (!f) return NULL;
+	f->proc_fun = proc_fun;
+	f->arg = arg;
+	f->result = NULL;
+	f->done = FALSE;
+	f->dropped = FALSE;
+	f->waiters = 0;
+	f->refs = 2; //one for the job, one for the user
+	pthread_mutex_init(&f->lock, NULL);
+	pthread_cond_init(&f->cond, NULL);
+
+	job = tp_job_create_ex(pTp, tp_future_run, tp_future_drop, 0);
+	if (job) {
+		job->arg = f;
+		if (tp_process_job_ex(pTp, job, timeout) == 0)
+			return f;
+		tp_job_destroy(job);
+	}
+
+	pthread_cond_destroy(&f->cond);
+	pthread_mutex_destroy(&f->lock);
+	free(f);
+	return NULL;
+}
+
+/**
+ * member function reality. wait until the job of the future is done.
+ * para:
+ * 	f: the future
+ * 	result: return value of the job, may be NULL
+ * return:
+ * 	0: successful; -1: the job is discarded without running
+ */
+int tp_future_wait(TpFuture *f, void **result) {
+	return tp_future_timedwait(f, TP_WAIT_FOREVER, result);
+}
+
+/**
+ * member function reality. wait until the job of the future is done or timeout.
+ * para:
+ * 	f: the future
+ * 	timeout: wait time in ms, 0 - don't wait, TP_WAIT_FOREVER - wait until done
+ * 	result: return value of the job, may be NULL
+ * return:
+ * 	0: successful; -1: not done after timeout, or the job is discarded
+ */
+int tp_future_timedwait(TpFuture *f, int timeout, void **result) {
+	struct timespec abs_timeout;
+	int err = 0;
+
+	if (!f) return -1;
+
+	if (!__atomic_load_n(&f->done, __ATOMIC_ACQUIRE)) {
+		if (timeout == 0) return -1;
+		if (timeout > 0) afterms(&abs_timeout, timeout);
+
+		pthread_mutex_lock(&f->lock);
+		f->waiters++;
+		while (!f->done && !err) {
+			if (timeout < 0)
+				err = pthread_cond_wait(&f->cond, &f->lock);
+			else
+				err = pthread_cond_timedwait(&f->cond, &f->lock, &abs_timeout);
+		}
+		f->waiters--;
+		err = f->done ? 0 : -1;
+		pthread_mutex_unlock(&f->lock);
+		if (err) return -1;
+	}
+
+	if (f->dropped) return -1;
+	if (result) *result = f->result;
+	return 0;
+}
+
+/**
+ * member function reality. check whether the job of the future is done without
+ * blocking.
+ * para:
+ * 	f: the future
+ * return:
+ * 	TRUE: done; FALSE: not yet
+ */
+BOOL tp_future_poll(TpFuture *f) {
+	return f && __atomic_load_n(&f->done, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * member function reality. release the future, the job is not affected if it
+ * is still running.
+ * para:
+ * 	f: the future
+ * return:
+ */
+void tp_future_free(TpFuture *f) {
+	if (f) tp_future_release(f);
+}
+
+static void tp_future_run(void *arg) {
+	TpFuture *f = (TpFuture *) arg;
+
+	tp_future_done(f, f->proc_fun(f->arg), FALSE);
+}
+
+static void tp_future_drop(void *arg) {
+	tp_future_done((TpFuture *) arg, NULL, TRUE);
+}
+
+static void tp_future_done(TpFuture *f, void *result, BOOL dropped) {
+	pthread_mutex_lock(&f->lock);
+	f->result = result;
+	f->dropped = dropped;
+	__atomic_store_n(&f->done, TRUE, __ATOMIC_RELEASE);
+	if (f->waiters)
+		pthread_cond_broadcast(&f->cond);
+	pthread_mutex_unlock(&f->lock);
+
+	tp_future_release(f);
+}
+
+static void tp_future_release(TpFuture *f) {
+	if (__atomic_sub_fetch(&f->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+		pthread_cond_destroy(&f->cond);
+		pthread_mutex_destroy(&f->lock);
+		free(f);
+	}
+}
+
+/**
+ * internal interface. wake up an idle thread to fetch jobs.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	the thread woken up, NULL if no thread is idle
+ */
+static TpThreadInfo *tp_wake_thread(TpThreadPool *pTp) {
+	TpThreadInfo *pThi = NULL;
+	unsigned i, node;
+
+	if (!__atomic_load_n(&pTp->idle_nr, __ATOMIC_SEQ_CST))
+		return NULL;
+
+	//a thread on the node of the caller first
+	node = tp_cur_node(pTp);
+	for (i = 0; i < pTp->node_num && !pThi; i++)
+		pThi = (TpThreadInfo *) ts_ring_deq_data(pTp->idle_q[(node + i) % pTp->node_num]);
+	if (pThi) {
+		__atomic_sub_fetch(&pTp->idle_nr, 1, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&pTp->busy_nr, 1, __ATOMIC_RELAXED);
+		__atomic_store_n(&pThi->state, TP_TH_BUSY, __ATOMIC_RELAXED);
+		tp_trace(pTp, TP_EV_WAKE, pThi->idx);
+		ts_event_post(&pThi->event);
+	}
+	return pThi;
+}
+
+/**
+ * internal interface. fetch a job for the work thread, from its local queue,
+ * the pending job queue and local queues of other threads in order. if no job
+ * is found, the thread is moved to idle_q.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	pThi: the work thread fetching job
+ * return:
+ * 	the job fetched, NULL if there's nothing to do
+ */
+static TpJob *tp_fetch_job(TpThreadPool *pTp, TpThreadInfo *pThi) {
+	TpJob *job;
+
+	while (1) {
+		//over the group quota, leave between jobs
+		if (__atomic_load_n(&pTp->shed_nr, __ATOMIC_RELAXED) && tp_park_thread(pTp, pThi))
+			return NULL;
+
+		//high priority jobs are not held up by the local queue
+		if (__atomic_load_n(&pTp->prio_stats[TP_PRIO_HIGH].queued, __ATOMIC_RELAXED)) {
+			pthread_mutex_lock(&pTp->job_lock);
+			job = tp_deq_job(pTp);
+			pthread_mutex_unlock(&pTp->job_lock);
+			if (job) return job;
+		}
+
+		job = (TpJob *) ws_deque_pop(pThi->local_q);
+		if (job) return job;
+
+		if (__atomic_load_n(&pTp->job_num, __ATOMIC_RELAXED)) {
+			pthread_mutex_lock(&pTp->job_lock);
+			job = tp_deq_job(pTp);
+			pthread_mutex_unlock(&pTp->job_lock);
+			if (job) return job;
+		}
+
+		job = tp_steal_job(pTp, pThi);
+		if (job) return job;
+
+		//stopped by tp_close(), don't touch idle_q any more
+		if (pThi->stop_flag)
+			return NULL;
+
+		//go idle with job_lock held, so a job queued meanwhile will
+		//find this thread in idle_q and wake it up
+		pthread_mutex_lock(&pTp->job_lock);
+		job = tp_deq_job(pTp);
+		if (!job) {
+			__atomic_store_n(&pThi->state, TP_TH_IDLE, __ATOMIC_RELAXED);
+			__atomic_sub_fetch(&pTp->busy_nr, 1, __ATOMIC_RELAXED);
+			ts_ring_enq_data(pTp->idle_q[pThi->node], pThi);
+			__atomic_add_fetch(&pTp->idle_nr, 1, __ATOMIC_SEQ_CST);
+		}
+		pthread_mutex_unlock(&pTp->job_lock);
+		if (job) return job;
+
+		//a job pushed to a local queue before idle_nr increased has woken
+		//nobody, wake an idle thread (maybe this one) to steal it
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (tp_local_job_num(pTp))
+			tp_wake_thread(pTp);
+		return NULL;
+	}
+}
+
+/**
+ * internal interface. dequeue a job from the pending job queue, job_lock must
+ * be held. each priority may be fetched prio_weight times in a round, a new
+ * round begins when no pending priority has credit left, so lower priority
+ * jobs get a share instead of starving behind higher ones.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	the job, NULL if the queue is empty
+ */
+static TpJob *tp_deq_job(TpThreadPool *pTp) {
+	TpJob *job;
+	unsigned i, prio = TP_PRIO_NUM;
+
+	if (!pTp->job_num)
+		return NULL;
+
+	while (prio == TP_PRIO_NUM) {
+		for (i = 0; i < TP_PRIO_NUM; i++) {
+			if (pTp->job_head[i] && pTp->prio_credit[i]) {
+				prio = i;
+				break;
+			}
+		}
+		if (prio == TP_PRIO_NUM) {
+			for (i = 0; i < TP_PRIO_NUM; i++)
+				pTp->prio_credit[i] = pTp->prio_weight[i];
+		}
+	}
+
+	job = pTp->job_head[prio];
+	pTp->job_head[prio] = job->next;
+	if (!pTp->job_head[prio]) pTp->job_tail[prio] = NULL;
+	pTp->prio_credit[prio]--;
+	pTp->prio_stats[prio].fetched++;
+	__atomic_sub_fetch(&pTp->prio_stats[prio].queued, 1, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&pTp->job_num, 1, __ATOMIC_RELAXED);
+	//submitters may wait for room of different priorities
+	pthread_cond_broadcast(&pTp->job_cond);
+	return job;
+}
+
+/**
+ * internal interface. steal a job from local queues of other threads.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	pThi: the thief
+ * return:
+ * 	the job stolen, NULL if all local queues are empty
+ */
+static TpJob *tp_steal_job(TpThreadPool *pTp, TpThreadInfo *pThi) {
+	unsigned i, j, n, pass;
+	WSDeque *dq;
+	TpJob *job;
+
+	n = __atomic_load_n(&pTp->local_num, __ATOMIC_ACQUIRE);
+	//threads of the same node first, their jobs' data is likely local
+	for (pass = 0; pass < (pTp->node_num > 1 ? 2 : 1); pass++) {
+		for (i = 1; i < n; i++) {
+			j = (pThi->idx + i) % n;
+			if ((j % pTp->node_num == pThi->node) == pass)
+				continue;
+			dq = pTp->local_q[j];
+			if (ws_deque_count(dq) && (job = (TpJob *) ws_deque_steal(dq)) != NULL)
+				return job;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * internal interface. get number of jobs in all local queues.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	the job number
+ */
+static unsigned tp_local_job_num(TpThreadPool *pTp) {
+	unsigned i, n, num = 0;
+
+	n = __atomic_load_n(&pTp->local_num, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n; i++)
+		num += ws_deque_count(pTp->local_q[i]);
+	return num;
+}
+
+/**
+ * internal interface. allocate a work thread slot, its local queue is created
+ * when the slot is used first time. the thread info and local queue are
+ * allocated on the node of the slot.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	thread info of the slot, NULL if all max_th_num slots are in use
+ */
+static TpThreadInfo *tp_get_slot(TpThreadPool *pTp) {
+	unsigned i, node;
+	int *id;
+	TpThreadInfo *pThi = NULL;
+
+	pthread_mutex_lock(&pTp->slot_lock);
+	for (i = 0; i < pTp->max_th_num; i++) {
+		if (!pTp->slot_th[i])
+			break;
+	}
+	if (i < pTp->max_th_num) {
+		node = i % pTp->node_num;
+		id = pTp->node_id ? &pTp->node_id[node] : NULL;
+		//slots are taken from the lowest index, so local queues are
+		//always created one after another
+		if (i == pTp->local_num) {
+			pTp->local_q[i] = ws_deque_create_ex(LOCAL_QUEUE_SIZE, tp_node_alloc, id);
+			if (pTp->local_q[i])
+				__atomic_store_n(&pTp->local_num, i + 1, __ATOMIC_RELEASE);
+		}
+		if (i < pTp->local_num)
+			pThi = (TpThreadInfo *) ts_slab_alloc(pTp->info_slab[node], TS_SLAB_SHARED);
+		if (pThi) {
+			pThi->idx = i;
+			pThi->node = node;
+			pThi->local_q = pTp->local_q[i];
+			pTp->slot_th[i] = pThi;
+		}
+	}
+	pthread_mutex_unlock(&pTp->slot_lock);
+
+	return pThi;
+}
+
+static void tp_put_slot(TpThreadPool *pTp, unsigned idx) {
+	pthread_mutex_lock(&pTp->slot_lock);
+	pTp->slot_th[idx] = NULL;
+	pthread_mutex_unlock(&pTp->slot_lock);
+}
+
+/**
+ * member function reality. add new thread into the pool and run immediately.
+ * the new thread fetches pending jobs by itself.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	idle: put the new thread into idle_q instead of running it
+ * return:
+ * 	pointer of TpThreadInfo
+ */
+static TpThreadInfo *tp_add_thread(TpThreadPool *pTp, BOOL idle) {
+	int err;
+	unsigned idx;
+	TpThreadInfo *pThi;
+	pthread_attr_t attr;
+
+	//the group may be out of threads
+	if (pTp->group && tp_group_take(pTp) != 0)
+		return NULL;
+
+	//new thread info struct, NULL if all slots are in use, current thread
+	//num reaches max_th_num
+	pThi = tp_get_slot(pTp);
+	if (!pThi) {
+		if (pTp->group)
+			tp_group_put(pTp);
+		return NULL;
+	}
+
+	pThi->tp_pool = pTp;
+	pThi->stop_flag = FALSE;
+	pThi->state = idle ? TP_TH_IDLE : TP_TH_BUSY;
+	ts_event_init(&pThi->event);
+	pThi->spin = __atomic_load_n(&pTp->spin_count, __ATOMIC_RELAXED);
+	pThi->proc_fun = NULL;
+	pThi->arg = NULL;
+	pThi->job = NULL;
+
+	//the thread holds the pool until it exits
+	__atomic_add_fetch(&pTp->refs, 1, __ATOMIC_RELAXED);
+	tp_thread_attr(pTp, pThi, &attr);
+	err = pthread_create(&pThi->thread_id, &attr, tp_work_thread, pThi);
+	pthread_attr_destroy(&attr);
+	if (0 != err) {
+		perror("tp_add_thread: pthread_create");
+		__atomic_sub_fetch(&pTp->refs, 1, __ATOMIC_RELAXED);
+		idx = pThi->idx;
+		ts_slab_free(pTp->info_slab[pThi->node], pThi, TS_SLAB_SHARED);
+		tp_put_slot(pTp, idx);
+		if (pTp->group)
+			tp_group_put(pTp);
+		return NULL;
+	}
+
+	__atomic_add_fetch(&pTp->th_num, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&pTp->th_created, 1, __ATOMIC_RELAXED);
+	tp_trace(pTp, TP_EV_SPAWN, pThi->idx);
+	if (idle) {
+		//the thread just waits for its event, it's safe to queue it now
+		ts_ring_enq_data(pTp->idle_q[pThi->node], pThi);
+		__atomic_add_fetch(&pTp->idle_nr, 1, __ATOMIC_SEQ_CST);
+	} else {
+		__atomic_add_fetch(&pTp->busy_nr, 1, __ATOMIC_RELAXED);
+		ts_event_post(&pThi->event);
+	}
+	return pThi;
+}
+
+/**
+ * member function reality. delete idle thread in the pool.
+ * the thread is stopped but not joined here, see tp_reap_threads().
+ * only called by the manager, the manage thread or the group manager.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	true: successful; false: failed
+ */
+int tp_delete_thread(TpThreadPool *pTp) {
+    TpThreadInfo *pThi = NULL;
+    TpRetired *r;
+    unsigned i;
+
+	//current thread num can't < min thread num
+	if (__atomic_load_n(&pTp->th_num, __ATOMIC_RELAXED) <= pTp->min_th_num)
+		return -1;
+	r = (TpRetired *) malloc(sizeof(TpRetired));
+	if (!r)
+		return -1;
+	//all threads are busy
+	for (i = 0; i < pTp->node_num && !pThi; i++)
+		pThi = (TpThreadInfo *) ts_ring_deq_data(pTp->idle_q[i]);
+	if(!pThi) {
+		free(r);
+		return -1;
+	}
+	__atomic_sub_fetch(&pTp->idle_nr, 1, __ATOMIC_SEQ_CST);
+	tp_retire_thread(pTp, pThi, r);
+	return 0;
+}
+
+/**
+ * internal interface. stop a thread out of idle_q, it's joined later by
+ * tp_reap_threads(). only called by the manager.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	pThi: the thread, idle or parked
+ * 	r: retired record of the thread
+ * return:
+ */
+static void tp_retire_thread(TpThreadPool *pTp, TpThreadInfo *pThi, TpRetired *r) {
+    unsigned idx;
+
+	__atomic_sub_fetch(&pTp->th_num, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&pTp->th_destroyed, 1, __ATOMIC_RELAXED);
+	
+    DEBUG("Delete idle thread 0x%08x\n", (unsigned)pThi->thread_id);
+    //close the idle thread, it's joined later
+    r->thread_id = pThi->thread_id;
+    r->pThi = pThi;
+    r->next = pTp->retired;
+    pTp->retired = r;
+    idx = pThi->idx;
+    tp_trace(pTp, TP_EV_RETIRE, idx);
+    pThi->stop_flag = TRUE;
+    ts_event_post(&pThi->event);
+
+	//the local queue of an idle thread is empty, it's kept for the next
+	//thread taking this slot. the stopping thread doesn't touch it
+	tp_put_slot(pTp, idx);
+	if (pTp->group)
+		tp_group_put(pTp);
+}
+
+/**
+ * internal interface. give up a busy thread between jobs when the pool is
+ * over its group quota. the thread waits in shed_q to be retired by the
+ * manager, no job is queued to it meanwhile.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	pThi: the calling work thread
+ * return:
+ * 	TRUE: parked, the thread has nothing to do
+ */
+static BOOL tp_park_thread(TpThreadPool *pTp, TpThreadInfo *pThi) {
+	unsigned n = __atomic_load_n(&pTp->shed_nr, __ATOMIC_RELAXED);
+
+	//jobs of the local queue are done first
+	if (ws_deque_count(pThi->local_q) || pThi->stop_flag)
+		return FALSE;
+	do {
+		if (!n || __atomic_load_n(&pTp->th_num, __ATOMIC_RELAXED) <= pTp->min_th_num)
+			return FALSE;
+	} while (!__atomic_compare_exchange_n(&pTp->shed_nr, &n, n - 1, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	__atomic_store_n(&pThi->state, TP_TH_IDLE, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&pTp->busy_nr, 1, __ATOMIC_RELAXED);
+	ts_ring_enq_data(pTp->shed_q, pThi);
+	return TRUE;
+}
+
+/**
+ * internal interface. retire threads parked by tp_park_thread(), only called
+ * by the manager.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	number of threads retired
+ */
+static unsigned tp_retire_parked(TpThreadPool *pTp) {
+	TpThreadInfo *pThi;
+	TpRetired *r;
+	unsigned n = 0;
+
+	if (!pTp->shed_q)
+		return 0;
+	while ((pThi = (TpThreadInfo *) ts_ring_deq_data(pTp->shed_q)) != NULL) {
+		r = (TpRetired *) malloc(sizeof(TpRetired));
+		if (!r) {
+			//try again next round
+			ts_ring_enq_data(pTp->shed_q, pThi);
+			break;
+		}
+		tp_retire_thread(pTp, pThi, r);
+		n++;
+	}
+	return n;
+}
+
+/**
+ * internal interface. real work thread.
+ * @params:
+ * 	arg: args for this method
+ * @return:
+ *	none
+ */
+static void *tp_work_thread(void *arg) {
+	TpThreadInfo *pThi = (TpThreadInfo *) arg;
+	TpThreadPool *pTp = pThi->tp_pool;
+	TpJob *job;
+	unsigned spin;
+	TpWorkerStats *st;
+	unsigned long long start, queued, begin = 0, end;
+
+	tp_self = pThi;
+	tp_thread_setup(pTp, pThi, NULL);
+
+#if 0
+	//wake up waiting thread, notify it I am ready
+	pthread_cond_signal(&pTp->tp_cond);
+#endif
+
+    while (1) {
+		//wait event for processing real job. poll it for a while first,
+		//a job coming soon is taken without sleeping and waking up
+		spin = __atomic_load_n(&pTp->spin_count, __ATOMIC_RELAXED);
+		if (ts_event_spin(&pThi->event, pThi->spin)) {
+			//spinning paid off, spin longer next time
+			pThi->spin = pThi->spin ? pThi->spin * 2 : TP_SPIN_MIN;
+			if (pThi->spin > spin) pThi->spin = spin;
+		} else {
+			pThi->spin /= 2;
+			if (pThi->spin < TP_SPIN_MIN) pThi->spin = spin < TP_SPIN_MIN ? spin : TP_SPIN_MIN;
+			tp_trace(pTp, TP_EV_PARK, 0);
+			ts_event_wait(&pThi->event, NULL);
+			if (!pThi->stop_flag)
+				tp_trace(pTp, TP_EV_UNPARK, 0);
+		}
+
+        //stop
+		if(pThi->stop_flag){
+			DEBUG("thread 0x%08x stop\n", (unsigned)pThi->thread_id);
+			break;
+		}
+
+        //process pending jobs until the queue is empty, then the thread is
+        //moved to idle_q by tp_fetch_job()
+		st = &pTp->slot_stats[pThi->idx].s;
+		start = tp_now_ns();
+		while ((job = tp_fetch_job(pTp, pThi)) != NULL) {
+			DEBUG("thread 0x%08x is running\n", (unsigned)pThi->thread_id);
+			//nobody waits for the job any more
+			if ((job->cancel || job->deadline_ns) && tp_job_expired(job)) {
+				tp_job_drop(job);
+				__atomic_store_n(&st->cancelled, st->cancelled + 1, __ATOMIC_RELAXED);
+				continue;
+			}
+			//jobs queued while timing is enabled
+			queued = job->submit_ns;
+			if (queued)
+				begin = tp_now_ns();
+			tp_trace(pTp, TP_EV_START, 0);
+			pThi->job = job;
+			job->proc_fun(job->arg);
+			pThi->job = NULL;
+			tp_job_destroy(job);
+
+			tp_trace(pTp, TP_EV_END, 0);
+			//written by this thread only, no locked add needed. a thread
+			//stopped by tp_close() still owns its slot here
+			__atomic_store_n(&st->completed, st->completed + 1, __ATOMIC_RELAXED);
+			if (queued) {
+				TpLatHist *hist = &__atomic_load_n(&pTp->slot_hist, __ATOMIC_ACQUIRE)[pThi->idx];
+				end = tp_now_ns();
+				tp_hist_add(hist->count[TP_LAT_WAIT], &hist->sum[TP_LAT_WAIT], begin - queued);
+				tp_hist_add(hist->count[TP_LAT_RUN], &hist->sum[TP_LAT_RUN], end - begin);
+			}
+
+			//stop at once when the pool is closed, jobs left are dropped
+			if(pThi->stop_flag){
+				break;
+			}
+		}
+		if(!pThi->stop_flag)
+			__atomic_store_n(&st->busy_ns, st->busy_ns + (tp_now_ns() - start), __ATOMIC_RELAXED);
+
+		if(pThi->stop_flag){
+			DEBUG("thread 0x%08x stop\n", (unsigned)pThi->thread_id);
+			break;
+		}
+	}
+
+    //the thread info is freed by the one stopping the thread, it may
+    //still post the event
+    DEBUG("thread 0x%08x exit\n", (unsigned)pThi->thread_id);
+    //the slot may be taken by a new thread now, jobs dropped by the last
+    //release go to the shared list instead of its slab cache
+    tp_self = NULL;
+    tp_release(pTp);
+    return NULL;
+}
+
+/**
+ * member function reality. get current thread pool status:idle, normal, busy, .etc.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	0: idle; 1: normal or busy(don't process)
+ */
+int tp_get_tp_status(TpThreadPool *pTp) {
+    float busy_rate = 0.0;
+    unsigned busy_nr, idle_nr;
+
+    //get busy thread number, counters are read without any lock
+    busy_nr = __atomic_load_n(&pTp->busy_nr, __ATOMIC_RELAXED);
+    idle_nr = __atomic_load_n(&pTp->idle_nr, __ATOMIC_RELAXED);
+    if (busy_nr+idle_nr == 0)
+        return 1;
+    busy_rate = busy_nr;
+    busy_rate = busy_rate / (busy_nr+idle_nr);
+
+    DEBUG("Thread pool status, total num: %d, busy num: %d, idle num: %d\n", \
+          (busy_nr+idle_nr), busy_nr, idle_nr);
+    if (busy_rate < pTp->busy_threshold)
+        return 0;//idle status
+    else
+        return 1;//busy or normal status
+}
+
+/**
+ * internal interface. manage thread pool to delete idle thread.
+ * para:
+ * 	pthread: thread struct ponter
+ * return:
+ */
+static void *tp_manage_thread(void *arg) {
+	TpThreadInfo *pThi = (TpThreadInfo *) arg;
+	TpThreadPool *pTp = pThi->tp_pool;
+	unsigned long now, next;
+
+	tp_thread_setup(pTp, NULL, "m");
+
+    while (1) {
+        struct timespec abs_timeout;
+		//woken up early by tp_dispatch() to create threads
+		now = tp_now_ms();
+		next = pTp->manage_next;
+    	afterms(&abs_timeout, next > now ? next - now : 0);
+        ts_event_wait(&pThi->event, &abs_timeout);
+    
+		if(pThi->stop_flag){
+			break;
+		}
+		tp_manage(pTp);
+    }
+
+    DEBUG("manage thread 0x%08x exit\n", (unsigned)pThi->thread_id);
+	return NULL;
+}
+
+/**
+ * internal interface. a round of the manager, run by the manage thread or
+ * the group manager of the pool. threads asked by submitters are created at
+ * once, the load is checked every sample_interval ms.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ */
+void tp_manage(TpThreadPool *pTp) {
+	unsigned long now;
+	unsigned busy_nr, idle_nr, pending, n;
+
+	tp_manage_self = pTp;
+	//threads given up to the group are gone before new ones come
+	tp_retire_parked(pTp);
+
+	//threads asked by submitters run at once, the reserve is for the
+	//next ones
+	n = __atomic_exchange_n(&pTp->spawn_nr, 0, __ATOMIC_RELAXED);
+	for (; n && tp_add_thread(pTp, FALSE); n--)
+		;
+	n = __atomic_load_n(&pTp->reserve, __ATOMIC_RELAXED);
+	while (__atomic_load_n(&pTp->idle_nr, __ATOMIC_RELAXED) < n && tp_add_thread(pTp, TRUE))
+		;
+
+	now = tp_now_ms();
+	if (now < pTp->manage_next)
+		return;
+	pTp->manage_next = now + __atomic_load_n(&pTp->sample_interval, __ATOMIC_RELAXED);
+
+	//threads stopped before have exited by now mostly
+	tp_reap_threads(pTp, FALSE);
+
+	busy_nr = __atomic_load_n(&pTp->busy_nr, __ATOMIC_RELAXED);
+	idle_nr = __atomic_load_n(&pTp->idle_nr, __ATOMIC_RELAXED);
+	pending = __atomic_load_n(&pTp->job_num, __ATOMIC_RELAXED);
+
+	if (pending && pTp->pending_last) {
+		//jobs keep waiting, all threads are busy
+		n = pending < pTp->max_th_num ? pending : pTp->max_th_num;
+		tp_dispatch(pTp, n);
+	} else if (busy_nr > pTp->busy_last && tp_get_tp_status(pTp) == 1) {
+		//load is rising, start idle threads before jobs have to wait
+		for (n = busy_nr - pTp->busy_last; n && tp_add_thread(pTp, TRUE); n--)
+			;
+	}
+	pTp->pending_last = pending;
+	pTp->busy_last = busy_nr;
+
+	//threads never needed in the last manage_interval are stopped,
+	//except the reserve
+	if (idle_nr < pTp->idle_low)
+		pTp->idle_low = idle_nr;
+	if (now - pTp->manage_window >= pTp->manage_interval * 1000UL) {
+		n = __atomic_load_n(&pTp->reserve, __ATOMIC_RELAXED);
+		for (n = pTp->idle_low > n ? pTp->idle_low - n : 0; n && tp_delete_thread(pTp) == 0; n--)
+			;
+		pTp->idle_low = __atomic_load_n(&pTp->idle_nr, __ATOMIC_RELAXED);
+		pTp->manage_window = now;
+	}
+}
+
+/**
+ * internal interface. give up n threads above min_th_num, asked by the group
+ * manager when the pool is over its quota. parked and idle threads are
+ * retired at once, busy ones park between jobs and are retired by the next
+ * round.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	n: threads to give up, 0 - stop giving up
+ * return:
+ */
+void tp_shed(TpThreadPool *pTp, unsigned n) {
+	unsigned parked;
+
+	tp_manage_self = pTp;
+	parked = tp_retire_parked(pTp);
+	n = n > parked ? n - parked : 0;
+	for (; n && tp_delete_thread(pTp) == 0; n--)
+		;
+	__atomic_store_n(&pTp->shed_nr, n, __ATOMIC_RELAXED);
+}
+
+//wake up the manager of the pool
+static void tp_post_manage(TpThreadPool *pTp) {
+	if (__atomic_load_n(&pTp->group, __ATOMIC_ACQUIRE))
+		tp_group_post(pTp);
+	else
+		ts_event_post(&pTp->manage->event);
+}
+
+float tp_get_busy_threshold(TpThreadPool *pTp){
+	return pTp->busy_threshold;
+}
+
+int tp_set_busy_threshold(TpThreadPool *pTp, float bt){
+	if(bt <= 1.0 && bt > 0.) {
+		pTp->busy_threshold = bt;
+        return 0;
+	}
+
+    return -1;
+}
+
+unsigned tp_get_manage_interval(TpThreadPool *pTp){
+	return pTp->manage_interval;
+}
+
+int tp_set_manage_interval(TpThreadPool *pTp, unsigned mi){
+	pTp->manage_interval = mi;
+    return 0;
+}
+
+unsigned tp_get_queue_capacity(TpThreadPool *pTp){
+	return pTp->job_capacity;
+}
+
+unsigned tp_get_sample_interval(TpThreadPool *pTp){
+	return __atomic_load_n(&pTp->sample_interval, __ATOMIC_RELAXED);
+}
+
+int tp_set_sample_interval(TpThreadPool *pTp, unsigned si){
+	if (!si) return -1;
+	__atomic_store_n(&pTp->sample_interval, si, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * member function reality. get statistics of the pool, counters are read
+ * without stopping the threads, so they may be slightly inconsistent.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	stats: statistics of the pool
+ * 	workers: counters of each work thread slot, NULL - not needed
+ * 	n: size of workers
+ * return:
+ * 	number of work thread slots ever used, workers[0] to workers[min(ret, n)-1]
+ * 	are filled; -1: failed
+ */
+int tp_get_stats(TpThreadPool *pTp, TpStats *stats, TpWorkerStats *workers, unsigned n){
+	unsigned i, num;
+	TpWorkerStats *st;
+
+	if (!pTp || !stats) return -1;
+
+	memset(stats, 0, sizeof(TpStats));
+	pthread_mutex_lock(&pTp->job_lock);
+	for (i = 0; i < TP_PRIO_NUM; i++) {
+		stats->submitted += pTp->prio_stats[i].submitted;
+		stats->rejected += pTp->prio_stats[i].rejected;
+	}
+	pthread_mutex_unlock(&pTp->job_lock);
+
+	stats->busy = __atomic_load_n(&pTp->busy_nr, __ATOMIC_RELAXED);
+	stats->idle = __atomic_load_n(&pTp->idle_nr, __ATOMIC_RELAXED);
+	stats->queued = __atomic_load_n(&pTp->job_num, __ATOMIC_RELAXED) + tp_local_job_num(pTp);
+	stats->threads = __atomic_load_n(&pTp->th_num, __ATOMIC_RELAXED);
+	stats->th_created = __atomic_load_n(&pTp->th_created, __ATOMIC_RELAXED);
+	stats->th_destroyed = __atomic_load_n(&pTp->th_destroyed, __ATOMIC_RELAXED);
+	stats->slab_chunks = ts_slab_chunks(pTp->job_slab);
+	stats->blocked = __atomic_load_n(&pTp->blocked, __ATOMIC_RELAXED);
+	stats->caller_runs = __atomic_load_n(&pTp->caller_runs, __ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(&pTp->dropped, __ATOMIC_RELAXED);
+	stats->overflowed = __atomic_load_n(&pTp->overflowed, __ATOMIC_RELAXED);
+
+	num = __atomic_load_n(&pTp->local_num, __ATOMIC_ACQUIRE);
+	for (i = 0; i < num; i++) {
+		st = &pTp->slot_stats[i].s;
+		if (workers && i < n) {
+			workers[i].completed = __atomic_load_n(&st->completed, __ATOMIC_RELAXED);
+			workers[i].submitted = __atomic_load_n(&st->submitted, __ATOMIC_RELAXED);
+			workers[i].busy_ns = __atomic_load_n(&st->busy_ns, __ATOMIC_RELAXED);
+			workers[i].cancelled = __atomic_load_n(&st->cancelled, __ATOMIC_RELAXED);
+		}
+		stats->completed += __atomic_load_n(&st->completed, __ATOMIC_RELAXED);
+		stats->submitted += __atomic_load_n(&st->submitted, __ATOMIC_RELAXED);
+		stats->busy_ns += __atomic_load_n(&st->busy_ns, __ATOMIC_RELAXED);
+		stats->cancelled += __atomic_load_n(&st->cancelled, __ATOMIC_RELAXED);
+	}
+	stats->worker_num = num;
+	return num;
+}
+
+/**
+ * member function reality. enable or disable timing of jobs, jobs queued
+ * while enabled are added to latency histograms when done.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	on: enable or disable
+ * return:
+ * 	0: successful; -1: no memory for histograms
+ */
+int tp_set_timing(TpThreadPool *pTp, BOOL on){
+	TpLatHist *hist = NULL, *old = NULL;
+
+	//histograms are kept until tp_close(), threads may still use them
+	if (on && !__atomic_load_n(&pTp->slot_hist, __ATOMIC_ACQUIRE)) {
+		if (posix_memalign((void **) &hist, TS_CACHE_LINE, pTp->max_th_num * sizeof(TpLatHist)) != 0)
+			return -1;
+		memset(hist, 0, pTp->max_th_num * sizeof(TpLatHist));
+		if (!__atomic_compare_exchange_n(&pTp->slot_hist, &old, hist,
+					FALSE, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			free(hist);
+	}
+	__atomic_store_n(&pTp->timing, on, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * member function reality. get latency percentiles of jobs timed.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	which: TP_LAT_WAIT or TP_LAT_RUN
+ * 	lat: the latency, values are upper bounds of histogram buckets
+ * return:
+ * 	0: successful; -1: failed
+ */
+int tp_get_latency(TpThreadPool *pTp, unsigned which, TpLatency *lat){
+	unsigned long count[TP_HIST_BUCKETS], n, target;
+	unsigned long long sum;
+	static const double pct[] = {50, 90, 99, 99.9};
+	unsigned long long *val[4];
+	unsigned i, j = 0;
+
+	if (!pTp || !lat || which > TP_LAT_RUN) return -1;
+
+	memset(lat, 0, sizeof(TpLatency));
+	val[0] = &lat->p50;
+	val[1] = &lat->p90;
+	val[2] = &lat->p99;
+	val[3] = &lat->p999;
+	lat->count = tp_hist_merge(pTp, which, count, &sum);
+	if (!lat->count)
+		return 0;
+	lat->mean = sum / lat->count;
+
+	for (i = 0, n = 0; i < TP_HIST_BUCKETS; i++) {
+		if (!count[i])
+			continue;
+		n += count[i];
+		for (; j < 4; j++) {
+			target = (unsigned long) (pct[j] / 100 * lat->count + 0.5);
+			if (n < target)
+				break;
+			*val[j] = tp_hist_value(i);
+		}
+		lat->max = tp_hist_value(i);
+	}
+	return 0;
+}
+
+unsigned long long tp_get_latency_pct(TpThreadPool *pTp, unsigned which, double pct){
+	unsigned long count[TP_HIST_BUCKETS], total, target, n = 0;
+	unsigned long long sum;
+	unsigned i;
+
+	if (!pTp || which > TP_LAT_RUN) return 0;
+
+	total = tp_hist_merge(pTp, which, count, &sum);
+	target = (unsigned long) (pct / 100 * total + 0.5);
+	for (i = 0; total && i < TP_HIST_BUCKETS; i++) {
+		n += count[i];
+		if (count[i] && n >= target)
+			return tp_hist_value(i);
+	}
+	return 0;
+}
+
+/**
+ * member function reality. enable or disable event tracing. each thread
+ * records its events in its own ring, the last TP_TRACE_SIZE events of each
+ * thread are kept for tp_trace_dump().
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	on: enable or disable
+ * return:
+ * 	0: successful; -1: no memory for trace rings
+ */
+int tp_set_tracing(TpThreadPool *pTp, BOOL on){
+	TpTraceRing *trace = NULL, *old = NULL;
+	size_t size = (pTp->max_th_num + 2) * sizeof(TpTraceRing);
+
+	//rings are kept until tp_close(), threads may still use them
+	if (on && !__atomic_load_n(&pTp->trace, __ATOMIC_ACQUIRE)) {
+		if (posix_memalign((void **) &trace, TS_CACHE_LINE, size) != 0)
+			return -1;
+		memset(trace, 0, size);
+		if (!__atomic_compare_exchange_n(&pTp->trace, &old, trace,
+					FALSE, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			free(trace);
+	}
+	__atomic_store_n(&pTp->tracing, on, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * member function reality. write events traced in chrome trace json, which
+ * can be loaded by chrome://tracing or perfetto. jobs and sleeping are shown
+ * as slices of each thread, other events as instants. events written while
+ * dumping may be garbled, disable tracing first for a clean dump.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	fp: file to write
+ * return:
+ * 	0: successful; -1: failed
+ */
+int tp_trace_dump(TpThreadPool *pTp, FILE *fp){
+	static const char *names[] = {"submit", "wake", "job", "job", "park", "park", "spawn", "retire"};
+	TpTraceRing *trace;
+	TpTraceEv *ev;
+	unsigned long head, i;
+	unsigned t, type, arg;
+	unsigned long long ts;
+	int pid = getpid();
+	BOOL open;
+	const char *sep = "";
+
+	if (!pTp || !fp) return -1;
+
+	fprintf(fp, "{\"traceEvents\":[");
+	trace = __atomic_load_n(&pTp->trace, __ATOMIC_ACQUIRE);
+	for (t = 0; trace && t < pTp->max_th_num + 2; t++) {
+		head = __atomic_load_n(&trace[t].head, __ATOMIC_ACQUIRE);
+		if (!head)
+			continue;
+		if (t < pTp->max_th_num)
+			fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"worker-%u\"}}", sep, pid, t, t);
+		else
+			fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+					sep, pid, t, t == pTp->max_th_num ? "manager" : "submitters");
+		sep = ",";
+
+		//older events are overwritten, an end without its begin is skipped
+		open = FALSE;
+		for (i = head > TP_TRACE_SIZE ? head - TP_TRACE_SIZE : 0; i < head; i++) {
+			ev = &trace[t].ev[i & (TP_TRACE_SIZE - 1)];
+			ts = __atomic_load_n(&ev->ts, __ATOMIC_RELAXED);
+			type = __atomic_load_n(&ev->type, __ATOMIC_RELAXED);
+			arg = __atomic_load_n(&ev->arg, __ATOMIC_RELAXED);
+			if (!ts || type > TP_EV_RETIRE)
+				continue;
+			switch (type) {
+			case TP_EV_START:
+			case TP_EV_PARK:
+				open = TRUE;
+				fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%u}",
+						names[type], ts / 1000, ts % 1000, pid, t);
+				break;
+			case TP_EV_END:
+			case TP_EV_UNPARK:
+				if (!open)
+					break;
+				open = FALSE;
+				fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"E\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%u}",
+						names[type], ts / 1000, ts % 1000, pid, t);
+				break;
+			default:
+				fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%u,\"args\":{\"%s\":%u}}",
+						names[type], ts / 1000, ts % 1000, pid, t, type == TP_EV_SUBMIT ? "jobs" : "thread", arg);
+				break;
+			}
+		}
+	}
+	fprintf(fp, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+	return ferror(fp) ? -1 : 0;
+}
+
+int tp_trace_dump_file(TpThreadPool *pTp, const char *path){
+	FILE *fp;
+	int err;
+
+	if (!pTp || !path) return -1;
+	fp = fopen(path, "w");
+	if (!fp) return -1;
+	err = tp_trace_dump(pTp, fp);
+	if (fclose(fp) != 0)
+		err = -1;
+	return err;
+}
+
+unsigned tp_get_reserve(TpThreadPool *pTp){
+	return __atomic_load_n(&pTp->reserve, __ATOMIC_RELAXED);
+}
+
+int tp_set_reserve(TpThreadPool *pTp, unsigned reserve){
+	if (reserve > pTp->max_th_num) return -1;
+
+	__atomic_store_n(&pTp->reserve, reserve, __ATOMIC_RELAXED);
+	tp_post_manage(pTp);
+    return 0;
+}
+
+/**
+ * member function reality. start idle threads up to max_th_num, usually at
+ * startup. threads not needed are stopped by the manage thread after
+ * manage_interval, down to min_th_num and the reserve.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	number of threads started
+ */
+int tp_prestart_all(TpThreadPool *pTp){
+	int n = 0;
+
+	if (__atomic_load_n(&pTp->shutdown, __ATOMIC_RELAXED))
+		return 0;
+	while (tp_add_thread(pTp, TRUE))
+		n++;
+	return n;
+}
+
+unsigned tp_get_spin_count(TpThreadPool *pTp){
+	return __atomic_load_n(&pTp->spin_count, __ATOMIC_RELAXED);
+}
+
+int tp_set_spin_count(TpThreadPool *pTp, unsigned spin){
+	__atomic_store_n(&pTp->spin_count, spin, __ATOMIC_RELAXED);
+    return 0;
+}
+
+unsigned tp_get_prio_weight(TpThreadPool *pTp, unsigned prio){
+	return prio < TP_PRIO_NUM ? pTp->prio_weight[prio] : 0;
+}
+
+int tp_set_prio_weight(TpThreadPool *pTp, unsigned prio, unsigned weight){
+	if (prio >= TP_PRIO_NUM || !weight) return -1;
+
+	pthread_mutex_lock(&pTp->job_lock);
+	pTp->prio_weight[prio] = weight;
+	if (pTp->prio_credit[prio] > weight)
+		pTp->prio_credit[prio] = weight;
+	pthread_mutex_unlock(&pTp->job_lock);
+    return 0;
+}
+
+int tp_get_prio_stats(TpThreadPool *pTp, unsigned prio, TpPrioStats *stats){
+	if (prio >= TP_PRIO_NUM || !stats) return -1;
+
+	pthread_mutex_lock(&pTp->job_lock);
+	*stats = pTp->prio_stats[prio];
+	pthread_mutex_unlock(&pTp->job_lock);
+    return 0;
+}
+
+int tp_set_queue_capacity(TpThreadPool *pTp, unsigned cap){
+	if (!cap) return -1;
+
+	pthread_mutex_lock(&pTp->job_lock);
+	pTp->job_capacity = cap;
+	pthread_cond_broadcast(&pTp->job_cond);
+	pthread_mutex_unlock(&pTp->job_lock);
+    return 0;
+}
+
+unsigned tp_get_policy(TpThreadPool *pTp){
+	unsigned policy;
+
+	pthread_mutex_lock(&pTp->job_lock);
+	policy = pTp->policy;
+	pthread_mutex_unlock(&pTp->job_lock);
+	return policy;
+}
+
+/**
+ * member function reality. set what to do with a job whose pending queue is
+ * still full after the timeout of its submission. submitters already waiting
+ * keep the policy they started with. work threads of the pool never wait for
+ * room, a job they would wait for is run by themselves under any policy.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	policy: TP_POLICY_REJECT - return -1, the job is not queued;
+ * 		TP_POLICY_BLOCK - submissions with timeout 0 wait until queued;
+ * 		TP_POLICY_CALLER_RUNS - the submitting thread runs the job;
+ * 		TP_POLICY_DROP_OLDEST - the oldest pending job of the same priority
+ * 		is dropped without running;
+ * 		TP_POLICY_CALLBACK - fun decides, the job is rejected if it fails
+ * 	fun: callback of TP_POLICY_CALLBACK, called by the submitting thread
+ * 	arg: passed to fun
+ * return:
+ * 	0: successful; -1: bad policy
+ */
+int tp_set_policy(TpThreadPool *pTp, unsigned policy, overflow_job fun, void *arg){
+	if (policy >= TP_POLICY_NUM || (policy == TP_POLICY_CALLBACK && !fun)) return -1;
+
+	pthread_mutex_lock(&pTp->job_lock);
+	pTp->policy = policy;
+	pTp->overflow_fun = fun;
+	pTp->overflow_arg = arg;
+	pthread_mutex_unlock(&pTp->job_lock);
     return 0;
 }
 
-static void afterms(struct timespec *timeout,unsigned long ms)
+/**
+ * internal interface. get the nodes work threads are spread over, by the cpus
+ * and numa option in attr.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	attr: options, NULL - default
+ * return:
+ * 	0: successful; -1: no cpu is available
+ */
+static int tp_init_nodes(TpThreadPool *pTp, const TpAttr *attr) {
+	cpu_set_t cpus, allowed, nodes, *node_cpus = NULL;
+	int *node_id = NULL;
+	unsigned i, n = 0;
+	char path[64];
+
+	pTp->node_num = 1;
+	pTp->node_id = NULL;
+	pTp->node_cpus = NULL;
+	if (!attr || (!attr->cpus && !attr->numa))
+		return 0;
+
+	//cpus given and allowed for the process, all allowed if not given
+	if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0)
+		return -1;
+	cpus = allowed;
+	if (attr->cpus) {
+		CPU_ZERO(&cpus);
+		for (i = 0; i < attr->cpu_num; i++) {
+			if (attr->cpus[i] >= 0 && attr->cpus[i] < CPU_SETSIZE)
+				CPU_SET(attr->cpus[i], &cpus);
+		}
+		CPU_AND(&cpus, &cpus, &allowed);
+	}
+	if (!CPU_COUNT(&cpus))
+		return -1;
+
+	//nodes having some of the cpus
+	if (attr->numa && tp_read_cpulist("/sys/devices/system/node/online", &nodes) > 0) {
+		node_cpus = (cpu_set_t *) calloc(CPU_COUNT(&nodes), sizeof(cpu_set_t));
+		node_id = (int *) calloc(CPU_COUNT(&nodes), sizeof(int));
+		for (i = 0; node_cpus && node_id && i < CPU_SETSIZE; i++) {
+			if (!CPU_ISSET(i, &nodes))
+				continue;
+			snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", i);
+			if (tp_read_cpulist(path, &node_cpus[n]) <= 0)
+				continue;
+			CPU_AND(&node_cpus[n], &node_cpus[n], &cpus);
+			if (CPU_COUNT(&node_cpus[n]))
+				node_id[n++] = i;
+		}
+	}
+
+	//topology unknown, all threads run on the cpus given
+	if (!n) {
+		free(node_id);
+		node_id = NULL;
+		free(node_cpus);
+		node_cpus = NULL;
+		if (!attr->cpus)
+			return 0;
+		node_cpus = (cpu_set_t *) malloc(sizeof(cpu_set_t));
+		if (!node_cpus)
+			return -1;
+		node_cpus[0] = cpus;
+		n = 1;
+	}
+
+	pTp->node_num = n;
+	pTp->node_id = node_id;
+	pTp->node_cpus = node_cpus;
+	return 0;
+}
+
+static void tp_free_nodes(TpThreadPool *pTp) {
+	unsigned i;
+
+	for (i = 0; pTp->idle_q && i < pTp->node_num; i++)
+		ts_ring_destroy(pTp->idle_q[i]);
+	free(pTp->idle_q);
+	pTp->idle_q = NULL;
+	free(pTp->node_id);
+	pTp->node_id = NULL;
+	free(pTp->node_cpus);
+	pTp->node_cpus = NULL;
+}
+
+/**
+ * internal interface. read a list like "0-3,8-11" from sysfs.
+ * para:
+ * 	path: the file
+ * 	set: numbers in the list
+ * return:
+ * 	count of numbers, -1 if the file can't be read
+ */
+static int tp_read_cpulist(const char *path, cpu_set_t *set) {
+	FILE *fp;
+	char buf[1024], *p, *end;
+	unsigned long a, b;
+
+	CPU_ZERO(set);
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+	p = fgets(buf, sizeof(buf), fp);
+	fclose(fp);
+	if (!p)
+		return -1;
+
+	while (*p >= '0' && *p <= '9') {
+		a = b = strtoul(p, &end, 10);
+		if (*end == '-')
+			b = strtoul(end + 1, &end, 10);
+		for (; a <= b && a < CPU_SETSIZE; a++)
+			CPU_SET(a, set);
+		p = *end == ',' ? end + 1 : end;
+	}
+	return CPU_COUNT(set);
+}
+
+/**
+ * internal interface. get the node of the calling thread.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	node index in the pool, 0 if the cpu isn't used by the pool
+ */
+static unsigned tp_cur_node(TpThreadPool *pTp) {
+	TpThreadInfo *pThi = tp_self;
+	unsigned i;
+	int cpu;
+
+	if (pTp->node_num == 1)
+		return 0;
+	if (pThi && pThi->tp_pool == pTp)
+		return pThi->node;
+
+	cpu = sched_getcpu();
+	for (i = 0; cpu >= 0 && i < pTp->node_num; i++) {
+		if (CPU_ISSET(cpu, &((cpu_set_t *) pTp->node_cpus)[i]))
+			return i;
+	}
+	return 0;
+}
+
+/**
+ * internal interface. allocate zeroed memory on a numa node, it can be
+ * released by free().
+ * para:
+ * 	size: bytes to allocate
+ * 	node: pointer to the system node id, NULL - any node
+ * return:
+ * 	the memory, NULL if failed
+ */
+static void *tp_node_alloc(size_t size, void *node) {
+	unsigned long mask[CPU_SETSIZE / (8 * sizeof(unsigned long))];
+	long page = sysconf(_SC_PAGESIZE);
+	void *p;
+
+	if (!node)
+		return calloc(1, size);
+
+	//pages of its own, so the policy is not shared with other memory
+	size = (size + page - 1) / page * page;
+	if (posix_memalign(&p, page, size) != 0)
+		return NULL;
+	memset(mask, 0, sizeof(mask));
+	mask[*(int *) node / (8 * sizeof(unsigned long))] |= 1UL << (*(int *) node % (8 * sizeof(unsigned long)));
+	//page reused from the heap may be there already, move it as well
+	syscall(SYS_mbind, p, size, MPOL_PREFERRED, mask, sizeof(mask) * 8 + 1, MPOL_MF_MOVE);
+	memset(p, 0, size);
+	return p;
+}
+
+/**
+ * internal interface. get attributes to create a thread with.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	pThi: the work thread, NULL for the manage thread and the timer thread
+ * 	attr: attributes initialized here, destroyed by the caller
+ * return:
+ */
+void tp_thread_attr(TpThreadPool *pTp, TpThreadInfo *pThi, pthread_attr_t *attr) {
+	struct sched_param param;
+	size_t stack_size = pTp->attr.stack_size;
+	cpu_set_t cpus;
+	unsigned i;
+
+	pthread_attr_init(attr);
+	if (stack_size) {
+		if (stack_size < (size_t) PTHREAD_STACK_MIN)
+			stack_size = PTHREAD_STACK_MIN;
+		pthread_attr_setstacksize(attr, stack_size);
+	}
+	if (pTp->attr.guard_size)
+		pthread_attr_setguardsize(attr, pTp->attr.guard_size);
+	if (!pThi) {
+		//any cpu of the pool
+		if (pTp->node_cpus) {
+			CPU_ZERO(&cpus);
+			for (i = 0; i < pTp->node_num; i++)
+				CPU_OR(&cpus, &cpus, &((cpu_set_t *) pTp->node_cpus)[i]);
+			pthread_attr_setaffinity_np(attr, sizeof(cpu_set_t), &cpus);
+		}
+		return;
+	}
+
+	//the thread runs on cpus of its node from the beginning
+	if (pTp->node_cpus)
+		pthread_attr_setaffinity_np(attr, sizeof(cpu_set_t),
+				&((cpu_set_t *) pTp->node_cpus)[pThi->node]);
+	//creating fails without the privilege for a real time policy
+	if (pTp->attr.sched_policy == SCHED_FIFO || pTp->attr.sched_policy == SCHED_RR) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = pTp->attr.sched_priority;
+		pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(attr, pTp->attr.sched_policy);
+		pthread_attr_setschedparam(attr, &param);
+	}
+}
+
+/**
+ * internal interface. apply options to the calling thread just created.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	pThi: the work thread, NULL for the manage thread and the timer thread
+ * 	role: suffix of the name if pThi is NULL, "m" - manage, "t" - timer
+ * return:
+ */
+void tp_thread_setup(TpThreadPool *pTp, TpThreadInfo *pThi, const char *role) {
+	char name[TP_NAME_SIZE];
+
+	if (pTp->attr.name) {
+		if (pThi)
+			snprintf(name, sizeof(name), "%s-%u", pTp->attr.name, pThi->idx);
+		else
+			snprintf(name, sizeof(name), "%s-%s", pTp->attr.name, role);
+		pthread_setname_np(pthread_self(), name);
+	}
+	//nice value is per thread on linux
+	if (pThi && pTp->attr.nice && pTp->attr.sched_policy != SCHED_FIFO
+			&& pTp->attr.sched_policy != SCHED_RR)
+		setpriority(PRIO_PROCESS, syscall(SYS_gettid), pTp->attr.nice);
+}
+
+/**
+ * internal interface. join threads stopped by tp_delete_thread().
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	wait: wait for threads still running, otherwise they're joined next time
+ * return:
+ */
+static void tp_reap_threads(TpThreadPool *pTp, BOOL wait) {
+	TpRetired *r, **pr = &pTp->retired;
+
+	while ((r = *pr) != NULL) {
+		if (wait)
+			pthread_join(r->thread_id, NULL);
+		else if (pthread_tryjoin_np(r->thread_id, NULL) != 0) {
+			pr = &r->next;
+			continue;
+		}
+		*pr = r->next;
+		ts_slab_free(pTp->info_slab[r->pThi->node], r->pThi, TS_SLAB_SHARED);
+		free(r);
+	}
+}
+
+/**
+ * internal interface. add a latency to a log-linear histogram, each power of
+ * 2 is split into 2^TP_HIST_SUB_BITS linear buckets.
+ * para:
+ * 	count: buckets
+ * 	sum: total latency
+ * 	ns: the latency
+ * return:
+ */
+static void tp_hist_add(unsigned long *count, unsigned long long *sum, unsigned long long ns) {
+	unsigned idx, e;
+
+	if (ns >= 1ULL << TP_HIST_MAX_BITS)
+		ns = (1ULL << TP_HIST_MAX_BITS) - 1;
+	if (ns < 1U << TP_HIST_SUB_BITS) {
+		idx = ns;
+	} else {
+		e = 63 - __builtin_clzll(ns);
+		idx = ((e - TP_HIST_SUB_BITS + 1) << TP_HIST_SUB_BITS)
+			+ ((ns >> (e - TP_HIST_SUB_BITS)) & ((1U << TP_HIST_SUB_BITS) - 1));
+	}
+	//written by the owner thread only
+	__atomic_store_n(&count[idx], count[idx] + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(sum, *sum + ns, __ATOMIC_RELAXED);
+}
+
+//largest latency in a bucket
+static unsigned long long tp_hist_value(unsigned idx) {
+	unsigned e, sub;
+
+	if (idx < 1U << TP_HIST_SUB_BITS)
+		return idx;
+	e = (idx >> TP_HIST_SUB_BITS) + TP_HIST_SUB_BITS - 1;
+	sub = idx & ((1U << TP_HIST_SUB_BITS) - 1);
+	return (((unsigned long long) ((1U << TP_HIST_SUB_BITS) + sub + 1)) << (e - TP_HIST_SUB_BITS)) - 1;
+}
+
+//add up histograms of all slots, return number of jobs
+static unsigned long tp_hist_merge(TpThreadPool *pTp, unsigned which, unsigned long *count, unsigned long long *sum) {
+	TpLatHist *hist = __atomic_load_n(&pTp->slot_hist, __ATOMIC_ACQUIRE);
+	unsigned long total = 0, c;
+	unsigned i, j, num;
+
+	memset(count, 0, TP_HIST_BUCKETS * sizeof(unsigned long));
+	*sum = 0;
+	if (!hist)
+		return 0;
+
+	num = __atomic_load_n(&pTp->local_num, __ATOMIC_ACQUIRE);
+	for (i = 0; i < num; i++) {
+		for (j = 0; j < TP_HIST_BUCKETS; j++) {
+			c = __atomic_load_n(&hist[i].count[which][j], __ATOMIC_RELAXED);
+			count[j] += c;
+			total += c;
+		}
+		*sum += __atomic_load_n(&hist[i].sum[which], __ATOMIC_RELAXED);
+	}
+	return total;
+}
+
+/**
+ * internal interface. record a trace event of the calling thread. work
+ * threads and the manage thread write their own rings without any atomic
+ * operation, other threads share the last ring.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	type: TP_EV_*
+ * 	arg: argument of the event
+ * return:
+ */
+static void tp_trace(TpThreadPool *pTp, unsigned type, unsigned arg) {
+	TpThreadInfo *pThi = tp_self;
+	TpTraceRing *ring;
+	TpTraceEv *ev;
+	unsigned long head;
+
+	if (!__atomic_load_n(&pTp->tracing, __ATOMIC_ACQUIRE))
+		return;
+	ring = __atomic_load_n(&pTp->trace, __ATOMIC_RELAXED);
+	if (pThi && pThi->tp_pool == pTp) {
+		ring += pThi->idx;
+		head = ring->head;
+	} else if (tp_manage_self == pTp) {
+		ring += pTp->max_th_num;
+		head = ring->head;
+	} else {
+		ring += pTp->max_th_num + 1;
+		head = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+	}
+
+	ev = &ring->ev[head & (TP_TRACE_SIZE - 1)];
+	__atomic_store_n(&ev->ts, tp_now_ns(), __ATOMIC_RELAXED);
+	__atomic_store_n(&ev->type, type, __ATOMIC_RELAXED);
+	__atomic_store_n(&ev->arg, arg, __ATOMIC_RELAXED);
+	if (ring != pTp->trace + pTp->max_th_num + 1)
+		__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * internal interface. slab cache of the calling thread, each work thread has
+ * the cache of its slot, other threads share the slab list with locking.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	cache index, TS_SLAB_SHARED if none
+ */
+static unsigned tp_slab_cache(TpThreadPool *pTp) {
+	TpThreadInfo *pThi = tp_self;
+
+	if (pThi && pThi->tp_pool == pTp)
+		return pThi->idx;
+	return TS_SLAB_SHARED;
+}
+
+static unsigned long long tp_now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long tp_now_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+void afterms(struct timespec *timeout,unsigned long ms)
 {
 	struct timeval tt;
 	gettimeofday(&tt,NULL);
@@ -6,8 +6,11 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <pthread.h>
-#include <semaphore.h>
 #include "tsqueue.h"
+#include "tsring.h"
+#include "wsdeque.h"
+#include "tsevent.h"
+#include "tsslab.h"
 
 #ifndef BOOL
 #define BOOL int
@@ -22,7 +25,53 @@
 #endif
 
 #define BUSY_THRESHOLD 0.5	//(busy thread)/(all thread threshold)
-#define MANAGE_INTERVAL 20	//tp manage thread sleep interval, every MANAGE_INTERVAL seconds, manager thread will try to recover idle threads as BUSY_THRESHOLD
+#define MANAGE_INTERVAL 20	//idle threads not needed for MANAGE_INTERVAL seconds are stopped by the manage thread, down to min_th_num
+#define TP_RESERVE 0	//idle threads kept ready by the manage thread, so jobs rarely wait for a thread to be created
+#define SAMPLE_INTERVAL 100	//tp manage thread checks load every SAMPLE_INTERVAL ms, threads are added when jobs wait or the busy rate rises over BUSY_THRESHOLD
+#define JOB_QUEUE_CAPACITY 1024	//max number of pending jobs waiting for a free thread
+#define LOCAL_QUEUE_SIZE 256	//size of the per thread local job queue, jobs submitted by a work thread are queued there
+#define TP_JOB_DATA_SIZE 64	//inline data size of a job, bigger data is allocated together with the job
+#define TP_SPIN_COUNT 2000	//max times an idle thread polls its event before sleeping, 0 - sleep at once
+#define TP_SPIN_MIN 16	//an idle thread spins between TP_SPIN_MIN and spin_count times, more if jobs come while spinning
+#define TP_NAME_SIZE 16	//max thread name length with '\0', including the "-idx" suffix
+#define TP_HIST_SUB_BITS 3	//latency histogram has 2^TP_HIST_SUB_BITS buckets for each power of 2, about 12% precision
+#define TP_HIST_MAX_BITS 40	//latency histogram range, up to 2^TP_HIST_MAX_BITS ns
+#define TP_HIST_BUCKETS ((TP_HIST_MAX_BITS - TP_HIST_SUB_BITS + 1) << TP_HIST_SUB_BITS)
+#define TP_LAT_WAIT 0	//latency from job queued to started
+#define TP_LAT_RUN 1	//latency from job started to done
+#define TP_TRACE_SIZE 4096	//events kept in each trace ring, a power of 2, older ones are overwritten
+#define TP_EV_SUBMIT 0	//trace event, jobs queued, arg - number of jobs
+#define TP_EV_WAKE 1	//trace event, an idle thread woken up, arg - its slot
+#define TP_EV_START 2	//trace event, a job started
+#define TP_EV_END 3	//trace event, a job done
+#define TP_EV_PARK 4	//trace event, a thread going to sleep
+#define TP_EV_UNPARK 5	//trace event, a thread woken up from sleep
+#define TP_EV_SPAWN 6	//trace event, a thread created, arg - its slot
+#define TP_EV_RETIRE 7	//trace event, a thread stopped, arg - its slot
+#define TP_TH_IDLE 0	//work thread state, waiting in idle_q
+#define TP_TH_BUSY 1	//work thread state, running or fetching jobs
+#define TP_PRIO_HIGH 0	//job priority, latency critical jobs
+#define TP_PRIO_NORMAL 1	//job priority, default
+#define TP_PRIO_LOW 2	//job priority, background jobs
+#define TP_PRIO_NUM 3
+#define TP_PRIO_WEIGHT_HIGH 16	//jobs of each priority fetched in a round when all priorities are pending,
+#define TP_PRIO_WEIGHT_NORMAL 4	//so lower priority jobs still make progress
+#define TP_PRIO_WEIGHT_LOW 1
+#define TP_BATCH_SIZE 64	//jobs created at a time by tp_process_jobs()
+#define TP_SLAB_CHUNK 256	//jobs allocated at a time by the job slab of the pool, the first chunk at tp_create()
+#define TP_SLAB_CACHE 64	//free jobs kept by each work thread, so jobs are allocated and freed without locking
+#define TP_WAIT_FOREVER -1	//timeout of tp_process_job_timed(), block until the job is queued
+#define TP_ESHUTDOWN -2	//returned by job submission once the pool is shutting down
+#define TP_SHUTDOWN_DRAIN 0	//tp_shutdown() mode, run all jobs queued, then stop
+#define TP_SHUTDOWN_TIMEOUT 1	//tp_shutdown() mode, run jobs queued until timeout, drop the rest
+#define TP_SHUTDOWN_NOW 2	//tp_shutdown() mode, drop jobs queued, stop after jobs running
+#define TP_DRAIN_INTERVAL 1	//tp_shutdown() checks if all jobs are done every TP_DRAIN_INTERVAL ms
+#define TP_POLICY_REJECT 0	//saturation policy, a job the pending queue has no room for is returned to the submitter, the default
+#define TP_POLICY_BLOCK 1	//saturation policy, submitters not giving a timeout wait for room
+#define TP_POLICY_CALLER_RUNS 2	//saturation policy, the submitting thread runs the job itself
+#define TP_POLICY_DROP_OLDEST 3	//saturation policy, the oldest pending job of the priority is dropped for the new one
+#define TP_POLICY_CALLBACK 4	//saturation policy, the job is passed to the overflow callback
+#define TP_POLICY_NUM 5
 
 #ifdef __cplusplus
 extern "C" {
@@ -30,39 +79,305 @@ extern "C" {
 
 typedef struct tp_thread_info_s TpThreadInfo;
 typedef struct tp_thread_pool_s TpThreadPool;
+typedef struct tp_job_s TpJob;
+typedef struct tp_future_s TpFuture;
+typedef struct tp_prio_stats_s TpPrioStats;
+typedef struct tp_attr_s TpAttr;
+typedef struct tp_retired_s TpRetired;
+typedef struct tp_stats_s TpStats;
+typedef struct tp_worker_stats_s TpWorkerStats;
+typedef struct tp_lat_hist_s TpLatHist;
+typedef struct tp_latency_s TpLatency;
+typedef struct tp_trace_ev_s TpTraceEv;
+typedef struct tp_trace_ring_s TpTraceRing;
+typedef struct tp_cancel_s TpCancel;
+typedef struct tp_timer_wheel_s TpTimerWheel;
+typedef struct tp_group_s TpGroup;
 
 typedef void (*process_job)(void *arg);
+typedef void *(*future_job)(void *arg); //job with a result, see tp_process_future()
+//called for a job the pending queue has no room for under TP_POLICY_CALLBACK, return 0 if the job is
+//taken care of, e.g. run or kept elsewhere, the job itself is destroyed after return; otherwise it's rejected
+typedef int (*overflow_job)(TpThreadPool *pTp, TpJob *job, void *arg);
+
+//pending job
+struct tp_job_s {
+	process_job proc_fun;
+	process_job drop_fun; //called instead of proc_fun if the job is discarded, may be NULL
+	void *arg;
+	TpJob *next;
+	unsigned prio; //TP_PRIO_HIGH, TP_PRIO_NORMAL or TP_PRIO_LOW
+	unsigned long long submit_ns; //time queued, 0 if timing is disabled
+	TpCancel *cancel; //dropped without running once cancelled, may be NULL
+	unsigned long long deadline_ns; //dropped without running if not started by then, CLOCK_MONOTONIC, 0 - none
+	TpThreadPool *tp_pool; //allocated from the job slab of the pool, NULL - by malloc()
+	union {
+		char data[TP_JOB_DATA_SIZE]; //job data created by tp_job_create(), arg points here
+		long double align_;
+		void *ptr_;
+	} u;
+};
+
+//cancellation token shared by jobs, see tp_cancel_create()
+struct tp_cancel_s {
+	BOOL cancelled;
+	unsigned refs; //the creator and jobs holding it
+};
+
+//per priority counters
+struct tp_prio_stats_s {
+	unsigned long submitted; //jobs queued
+	unsigned long fetched; //jobs fetched by work threads
+	unsigned long rejected; //jobs not queued since the queue is full
+	unsigned queued; //jobs pending now
+};
+
+//counters of a work thread slot, written by the thread only
+struct tp_worker_stats_s {
+	unsigned long completed; //jobs done
+	unsigned long submitted; //jobs queued to the local queue
+	unsigned long long busy_ns; //time spent out of idle_q, in ns
+	unsigned long cancelled; //jobs dropped since cancelled or past deadline
+};
+
+//counters of a work thread slot, one cache line each
+typedef union {
+	TpWorkerStats s;
+	char pad[TS_CACHE_LINE];
+} TpWorkerSlot;
+
+//pool statistics, see tp_get_stats()
+struct tp_stats_s {
+	unsigned long submitted; //jobs queued
+	unsigned long completed; //jobs done
+	unsigned long rejected; //jobs not queued since the queue is full
+	unsigned long cancelled; //jobs dropped since cancelled or past deadline
+	unsigned busy; //busy threads now
+	unsigned idle; //idle threads now
+	unsigned queued; //jobs pending now, in the pending queue and local queues
+	unsigned threads; //threads now
+	unsigned long th_created; //threads created
+	unsigned long th_destroyed; //threads stopped by the manage thread
+	unsigned long slab_chunks; //chunks allocated by the job slab, flat once the pool is warmed up
+	unsigned long blocked; //submissions waited for room in the pending queue
+	unsigned long caller_runs; //jobs run by the submitter under TP_POLICY_CALLER_RUNS
+	unsigned long dropped; //pending jobs dropped for new ones under TP_POLICY_DROP_OLDEST
+	unsigned long overflowed; //jobs taken care of by the overflow callback
+	unsigned long long busy_ns; //time spent by all threads out of idle_q, in ns
+	unsigned worker_num; //work thread slots ever used
+};
+
+//latency histograms of a work thread slot, written by the thread only
+struct tp_lat_hist_s {
+	unsigned long count[2][TP_HIST_BUCKETS]; //jobs in each bucket of TP_LAT_WAIT and TP_LAT_RUN
+	unsigned long long sum[2]; //total latency in ns
+} __attribute__((aligned(TS_CACHE_LINE)));
+
+//latency percentiles merged from all slots, in ns
+struct tp_latency_s {
+	unsigned long count; //jobs timed
+	unsigned long long mean;
+	unsigned long long p50;
+	unsigned long long p90;
+	unsigned long long p99;
+	unsigned long long p999;
+	unsigned long long max;
+};
+
+//trace event, see tp_trace_dump()
+struct tp_trace_ev_s {
+	unsigned long long ts; //time in ns
+	unsigned type; //TP_EV_*
+	unsigned arg;
+};
+
+//trace events of a thread, written by the thread only, except the ring shared by non pool threads
+struct tp_trace_ring_s {
+	unsigned long head; //events ever written, the next one goes to ev[head % TP_TRACE_SIZE]
+	TpTraceEv ev[TP_TRACE_SIZE];
+} __attribute__((aligned(TS_CACHE_LINE)));
+
+//options of tp_create_ex(), initialized by tp_attr_init()
+struct tp_attr_s {
+	const int *cpus; //cpus the work threads run on, the manage thread and the timer thread run on any of them, NULL - not pinned
+	unsigned cpu_num; //number of cpus
+	BOOL numa; //group work threads by numa node, a thread runs on cpus of its node and takes jobs of its node first
+	size_t stack_size; //stack size of threads, 0 - default
+	size_t guard_size; //guard size below the stack, 0 - default
+	int sched_policy; //SCHED_OTHER, SCHED_FIFO or SCHED_RR of work threads
+	int sched_priority; //priority for SCHED_FIFO and SCHED_RR
+	int nice; //nice value of work threads for SCHED_OTHER
+	const char *name; //thread name prefix, threads are named "name-idx", "name-m" for the manage thread and "name-t" for the timer thread, NULL - not named
+	unsigned policy; //TP_POLICY_*, what to do with a job when the pending queue of its priority is full
+	overflow_job overflow_fun; //callback of TP_POLICY_CALLBACK
+	void *overflow_arg;
+	TpGroup *group; //group sharing a thread budget, managed by the group instead of a manage thread, other options don't apply to the group manager, NULL - none
+	unsigned weight; //share of the group budget against other pools, 0 - 1
+};
+
+//completion handle of a job submitted by tp_process_future()
+struct tp_future_s {
+	future_job proc_fun;
+	void *arg;
+	void *result; //return value of proc_fun
+	BOOL done; //set when proc_fun returns or the job is discarded
+	BOOL dropped; //the job is discarded without running
+	unsigned waiters; //threads blocked in tp_future_wait()
+	unsigned refs; //released by the job and by tp_future_free()
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
 
 //thread info
 struct tp_thread_info_s {
 	pthread_t thread_id; //thread id num
 	BOOL stop_flag; //whether stop the thread
-	sem_t *event_sem;    
+	unsigned state; //TP_TH_IDLE or TP_TH_BUSY
+	TSEvent event; //posted to wake up the thread
+	unsigned spin; //times to poll the event before sleeping
 	process_job proc_fun;
 	void *arg;
 	TpThreadPool *tp_pool;
+	unsigned idx; //slot index in the pool
+	WSDeque *local_q; //jobs submitted by this thread, stolen by idle threads
+	unsigned node; //node index in the pool, slot idx % node_num
+	TpJob *job; //job running, see tp_job_cancelled()
 };
 
 //main thread pool struct
 struct tp_thread_pool_s {
 	unsigned min_th_num; //min thread number in the pool
 	unsigned max_th_num; //max thread number in the pool	
-    TSQueue *busy_q; //busy queue
-	TSQueue *idle_q; //idle queue
+	TSRing **idle_q; //idle queue of each node
+	unsigned th_num; //current work thread number
+	unsigned busy_nr; //number of busy threads
+	unsigned idle_nr; //number of threads in idle_q
 
     TpThreadInfo *manage;
 	float busy_threshold; //
 	unsigned manage_interval; //
+	unsigned sample_interval; //
+	TpRetired *retired; //threads stopped by the manage thread, not joined yet
+	BOOL shutdown; //no more jobs accepted, protected by job_lock
+	unsigned dispatching; //submitters dispatching jobs queued before shutdown
+	unsigned refs; //work threads alive and the owner, the pool is freed by the last one
+	TpTimerWheel *timer; //jobs scheduled by tp_schedule_*(), created with the first one
+	unsigned reserve; //idle threads kept ready
+	unsigned spawn_nr; //threads requested by submitters, created by the manage thread
+	unsigned spin_count; //max times an idle thread polls its event before sleeping
+	unsigned long manage_next; //next load check of the manager, in ms
+	unsigned long manage_window; //start of the current manage_interval, in ms
+	unsigned busy_last; //busy threads at the last load check
+	unsigned pending_last; //pending jobs at the last load check
+	unsigned idle_low; //fewest idle threads in the current manage_interval
+
+	TpGroup *group; //see TpAttr.group, NULL once the pool leaves it
+	TpThreadPool *group_next; //next pool of the group, protected by the group lock
+	unsigned weight;
+	unsigned group_threads; //threads counted in the group budget, protected by the budget lock
+	unsigned quota; //threads above min_th_num allowed by the group
+	unsigned want; //threads above min_th_num wanted at the last balance
+	unsigned shed_nr; //busy threads to give up between jobs, over the quota
+	TSRing *shed_q; //threads given up, retired by the manager
+
+	pthread_mutex_t job_lock; //protect the pending job queue
+	pthread_cond_t job_cond; //signaled when a pending job is fetched
+	TpJob *job_head[TP_PRIO_NUM]; //pending job queue of each priority, work threads fetch jobs from here
+	TpJob *job_tail[TP_PRIO_NUM];
+	unsigned job_num; //pending job number of all priorities
+	unsigned job_capacity; //max pending job number of each priority
+	unsigned prio_weight[TP_PRIO_NUM]; //jobs of each priority fetched in a round
+	unsigned prio_credit[TP_PRIO_NUM]; //jobs of each priority still can be fetched in this round
+	TpPrioStats prio_stats[TP_PRIO_NUM];
+	unsigned policy; //TP_POLICY_*, protected by job_lock
+	overflow_job overflow_fun;
+	void *overflow_arg;
+	unsigned long blocked; //counters of saturation policies, see TpStats
+	unsigned long caller_runs;
+	unsigned long dropped;
+	unsigned long overflowed;
+	TSSlab *job_slab; //jobs created by tp_job_create_ex(), a cache for each slot
+
+	pthread_mutex_t slot_lock; //protect slot_th
+	TpThreadInfo **slot_th; //work thread slots, max_th_num in total, NULL if free
+	TSSlab **info_slab; //thread infos of each node, in memory of the node
+	WSDeque **local_q; //local job queue of each slot, kept when the slot is freed
+	unsigned local_num; //number of local queues created
+	TpWorkerSlot *slot_stats; //counters of each slot, kept when the slot is freed
+	unsigned long th_created; //threads created
+	unsigned long th_destroyed; //threads stopped by the manage thread
+	BOOL timing; //jobs are timed
+	TpLatHist *slot_hist; //latency histograms of each slot, allocated when timing is enabled first
+	BOOL tracing; //events are traced
+	TpTraceRing *trace; //trace rings of each slot, the manage thread and other threads, allocated when tracing is enabled first
+
+	unsigned node_num; //numa nodes the work threads are spread over, 1 if not numa aware
+	int *node_id; //system numa node id of each node, NULL - not numa aware
+	void *node_cpus; //cpu_set_t of each node, NULL - threads are not pinned
+
+	TpAttr attr; //options of threads, cpus are not kept
+	char name[TP_NAME_SIZE]; //name prefix of threads
 };
 
 TpThreadPool *tp_create(unsigned min_num, unsigned max_num);
+TpThreadPool *tp_create_ex(unsigned min_num, unsigned max_num, const TpAttr *attr); //attr - NULL, same as tp_create()
+void tp_attr_init(TpAttr *attr);
 void tp_close(TpThreadPool *pTp, BOOL wait);
+int tp_shutdown(TpThreadPool *pTp, unsigned mode, int timeout); //timeout in ms for TP_SHUTDOWN_TIMEOUT, return number of jobs dropped
 int tp_process_job(TpThreadPool *pTp, process_job proc_fun, void *arg);
+int tp_process_job_timed(TpThreadPool *pTp, process_job proc_fun, void *arg, int timeout); //timeout in ms, 0 - no wait, TP_WAIT_FOREVER - block
+int tp_process_job_prio(TpThreadPool *pTp, process_job proc_fun, void *arg, unsigned prio, int timeout);
+int tp_process_job_cancel(TpThreadPool *pTp, process_job proc_fun, void *arg, TpCancel *c, const struct timespec *deadline, int timeout); //deadline - CLOCK_MONOTONIC, NULL - none
 
 float tp_get_busy_threshold(TpThreadPool *pTp);
 int tp_set_busy_threshold(TpThreadPool *pTp, float bt);
 unsigned tp_get_manage_interval(TpThreadPool *pTp);
-int tp_set_manage_interval(TpThreadPool *pTp, unsigned mi); //mi - manager interval time, in second
+int tp_set_manage_interval(TpThreadPool *pTp, unsigned mi); //mi - idle time before a thread is stopped, in second
+unsigned tp_get_sample_interval(TpThreadPool *pTp);
+int tp_set_sample_interval(TpThreadPool *pTp, unsigned si); //si - load check interval of the manager, in ms
+int tp_get_stats(TpThreadPool *pTp, TpStats *stats, TpWorkerStats *workers, unsigned n); //workers - counters of n slots at most, NULL - not needed
+int tp_set_timing(TpThreadPool *pTp, BOOL on); //time jobs for tp_get_latency()
+int tp_get_latency(TpThreadPool *pTp, unsigned which, TpLatency *lat); //which - TP_LAT_WAIT or TP_LAT_RUN
+unsigned long long tp_get_latency_pct(TpThreadPool *pTp, unsigned which, double pct); //pct - percentile, 0 to 100
+int tp_set_tracing(TpThreadPool *pTp, BOOL on); //trace events for tp_trace_dump()
+int tp_trace_dump(TpThreadPool *pTp, FILE *fp); //write events traced in chrome trace json
+int tp_trace_dump_file(TpThreadPool *pTp, const char *path);
+unsigned tp_get_reserve(TpThreadPool *pTp);
+int tp_set_reserve(TpThreadPool *pTp, unsigned reserve); //reserve - idle threads kept ready, up to max_th_num
+int tp_prestart_all(TpThreadPool *pTp); //start threads up to max_th_num, return number of threads started
+unsigned tp_get_spin_count(TpThreadPool *pTp);
+int tp_set_spin_count(TpThreadPool *pTp, unsigned spin); //spin - max times to poll before sleeping, 0 - no spin
+TpJob *tp_job_create(process_job proc_fun, process_job drop_fun, size_t data_size); //arg points to data_size bytes kept in the job
+TpJob *tp_job_create_ex(TpThreadPool *pTp, process_job proc_fun, process_job drop_fun, size_t data_size); //from the slab of pTp, queued to pTp only
+void tp_job_destroy(TpJob *job);
+void tp_job_set_cancel(TpJob *job, TpCancel *c); //the job holds its own reference of c
+void tp_job_set_deadline(TpJob *job, const struct timespec *abstime); //abstime - CLOCK_MONOTONIC, NULL - none
+BOOL tp_job_cancelled(void); //called by a job, TRUE if it's cancelled or past its deadline
+
+TpCancel *tp_cancel_create(void);
+void tp_cancel(TpCancel *c);
+BOOL tp_cancelled(const TpCancel *c);
+void tp_cancel_free(TpCancel *c);
+int tp_process_job_ex(TpThreadPool *pTp, TpJob *job, int timeout); //the pool owns the job if successful
+int tp_process_jobs(TpThreadPool *pTp, process_job proc_fun, void **args, unsigned n); //return number of jobs queued
+int tp_process_jobs_timed(TpThreadPool *pTp, process_job proc_fun, void **args, unsigned n, int timeout);
+int tp_process_jobs_ex(TpThreadPool *pTp, TpJob **jobs, unsigned n, int timeout); //the pool owns the jobs queued
+
+TpFuture *tp_process_future(TpThreadPool *pTp, future_job proc_fun, void *arg, int timeout); //timeout same as tp_process_job_timed()
+int tp_future_wait(TpFuture *f, void **result);
+int tp_future_timedwait(TpFuture *f, int timeout, void **result); //timeout in ms
+BOOL tp_future_poll(TpFuture *f);
+void tp_future_free(TpFuture *f);
+
+unsigned tp_get_queue_capacity(TpThreadPool *pTp);
+int tp_set_queue_capacity(TpThreadPool *pTp, unsigned cap); //cap - max pending job number of each priority
+unsigned tp_get_prio_weight(TpThreadPool *pTp, unsigned prio);
+int tp_set_prio_weight(TpThreadPool *pTp, unsigned prio, unsigned weight);
+int tp_get_prio_stats(TpThreadPool *pTp, unsigned prio, TpPrioStats *stats);
+unsigned tp_get_policy(TpThreadPool *pTp);
+int tp_set_policy(TpThreadPool *pTp, unsigned policy, overflow_job fun, void *arg); //fun, arg - callback of TP_POLICY_CALLBACK
+
+void afterms(struct timespec *timeout, unsigned long ms); //CLOCK_REALTIME ms from now, for pthread_cond_timedwait()
 
 #ifdef __cplusplus
 }
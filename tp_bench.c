@@ -0,0 +1,577 @@
+/**
+ * @file tp_bench.c
+ * @version 1.0
+ * @author Tristan Lee <tristan.lee@qq.com>
+ * @brief benchmarks of the thread pool
+ *
+ * each benchmark is run on the pool and on a thread created per job, for
+ * every thread number given. results are written one per line, in csv or
+ * json lines, to be compared between builds and hosts.
+ *
+ * 	throughput: empty jobs submitted one by one, then by tp_process_jobs()
+ * 	latency: time from submitted to started, jobs submitted in bursts of
+ * 		the thread number to a quiet pool
+ * 	fanout: rounds of jobs submitted together and waited for together
+ * 	contention: empty jobs submitted by many producers at the same time
+ * 	parallel_for: a loop over an array cut into chunks
+ *
+ * build:
+ * 	gcc -O2 -o tp_bench tp_bench.c thread_pool.c tsqueue.c tsring.c
+ * 		wsdeque.c tsevent.c tp_parallel.c tp_timer.c tsslab.c tp_group.c -lpthread
+ *
+ * Change Logs:
+ * Date			Author		Notes
+ * 2026-10-18	Tristan		the initial version
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "thread_pool.h"
+#include "tp_parallel.h"
+
+#define BENCH_JOBS 100000	//jobs of each run, -n
+#define BENCH_REPEAT 3	//runs of each benchmark, the best is reported, -r
+#define BENCH_PRODUCERS 4	//submitting threads of the contention benchmark, -p
+#define BENCH_FANOUT 64	//jobs of each fanout round
+#define BENCH_ARRAY (1 << 20)	//array size of the parallel_for benchmark
+#define BENCH_MAX_THREADS 64	//max thread numbers given by -t
+
+typedef struct bench_latch_s BenchLatch;
+typedef struct bench_result_s BenchResult;
+typedef struct bench_sample_s BenchSample;
+typedef struct bench_producer_s BenchProducer;
+
+//counts down finished jobs, the waiter is woken up by the last one
+struct bench_latch_s {
+	unsigned left;
+	TSEvent done;
+};
+
+//a line of the output
+struct bench_result_s {
+	const char *bench;
+	const char *impl; //"pool" or "pthread"
+	unsigned threads;
+	unsigned producers;
+	unsigned long ops; //jobs, rounds or loop indexes done
+	unsigned long long ns; //time of the best run
+	unsigned long long p50, p90, p99, p999, max; //latency in ns, latency benchmark only
+};
+
+//a job of the latency benchmark
+struct bench_sample_s {
+	unsigned long long submit;
+	unsigned long long start;
+	BenchLatch *latch;
+};
+
+//a submitting thread of the contention benchmark
+struct bench_producer_s {
+	TpThreadPool *pool; //NULL - create a thread per job
+	unsigned long jobs;
+	BenchLatch *latch;
+	pthread_barrier_t *barrier;
+};
+
+static unsigned long bench_jobs = BENCH_JOBS;
+static unsigned bench_repeat = BENCH_REPEAT;
+static unsigned bench_producers = BENCH_PRODUCERS;
+static BOOL bench_json = FALSE;
+static double *bench_array;
+
+static unsigned long long bench_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void latch_init(BenchLatch *l, unsigned n) {
+	l->left = n;
+	ts_event_init(&l->done);
+}
+
+static void latch_count(BenchLatch *l) {
+	if (__atomic_sub_fetch(&l->left, 1, __ATOMIC_ACQ_REL) == 0)
+		ts_event_post(&l->done);
+}
+
+//the latch is posted once, so waiting for the event instead of left makes
+//sure the last job has left the latch before it's used again
+static void latch_wait(BenchLatch *l) {
+	ts_event_wait(&l->done, NULL);
+}
+
+static void empty_job(void *arg) {
+	latch_count((BenchLatch *) arg);
+}
+
+static void *empty_thread(void *arg) {
+	latch_count((BenchLatch *) arg);
+	return NULL;
+}
+
+static void sample_job(void *arg) {
+	BenchSample *s = (BenchSample *) arg;
+
+	s->start = bench_now();
+	latch_count(s->latch);
+}
+
+//joined instead of counted
+static void *sample_thread(void *arg) {
+	((BenchSample *) arg)->start = bench_now();
+	return NULL;
+}
+
+static void array_job(void *arg, long begin, long end) {
+	long i;
+
+	(void) arg;
+	for (i = begin; i < end; i++)
+		bench_array[i] = bench_array[i] * 1.000001 + 1.0;
+}
+
+/**
+ * internal interface. run n jobs, each on a new thread, at most max threads
+ * are running at a time.
+ * para:
+ * 	fun: the job
+ * 	args: args of the jobs, args[i * step]
+ * 	n: number of jobs
+ * 	max: threads running at a time
+ * return:
+ * 	0: successful; -1: failed to create a thread
+ */
+static int spawn_jobs(void *(*fun)(void *), char *args, size_t step, unsigned long n, unsigned max) {
+	pthread_t tids[BENCH_MAX_THREADS];
+	unsigned long i = 0;
+	unsigned j, m;
+	int err = 0;
+
+	while (i < n && !err) {
+		for (m = 0; m < max && i < n; m++, i++) {
+			if (pthread_create(&tids[m], NULL, fun, args + i * step) != 0) {
+				err = -1;
+				break;
+			}
+		}
+		for (j = 0; j < m; j++)
+			pthread_join(tids[j], NULL);
+	}
+	return err;
+}
+
+static TpThreadPool *bench_pool(unsigned threads) {
+	TpThreadPool *pTp = tp_create(threads, threads);
+	BenchLatch latch;
+	unsigned long i;
+
+	if (!pTp) {
+		fprintf(stderr, "tp_bench: tp_create(%u) failed\n", threads);
+		exit(1);
+	}
+	//warm up, the threads and their queues are ready from now on
+	latch_init(&latch, threads * 16);
+	for (i = 0; i < threads * 16; i++)
+		tp_process_job_timed(pTp, empty_job, &latch, TP_WAIT_FOREVER);
+	latch_wait(&latch);
+	return pTp;
+}
+
+static void bench_report(BenchResult *r) {
+	double ops = r->ns ? r->ops * 1e9 / r->ns : 0;
+
+	if (bench_json) {
+		printf("{\"bench\":\"%s\",\"impl\":\"%s\",\"threads\":%u,\"producers\":%u,\"ops\":%lu,"
+				"\"ns\":%llu,\"ops_per_sec\":%.0f,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}\n",
+				r->bench, r->impl, r->threads, r->producers, r->ops, r->ns, ops,
+				r->p50, r->p90, r->p99, r->p999, r->max);
+	} else {
+		printf("%s,%s,%u,%u,%lu,%llu,%.0f,%llu,%llu,%llu,%llu,%llu\n",
+				r->bench, r->impl, r->threads, r->producers, r->ops, r->ns, ops,
+				r->p50, r->p90, r->p99, r->p999, r->max);
+	}
+	fflush(stdout);
+}
+
+static void bench_begin(BenchResult *r, const char *bench, const char *impl, unsigned threads) {
+	memset(r, 0, sizeof(BenchResult));
+	r->bench = bench;
+	r->impl = impl;
+	r->threads = threads;
+	r->ns = ~0ULL;
+}
+
+//keep the best run
+static void bench_run_done(BenchResult *r, unsigned long long begin) {
+	unsigned long long ns = bench_now() - begin;
+
+	if (ns < r->ns)
+		r->ns = ns;
+}
+
+static void bench_throughput(unsigned threads) {
+	TpThreadPool *pTp = bench_pool(threads);
+	BenchLatch latch;
+	BenchResult r;
+	void **args;
+	unsigned long i, n;
+	unsigned long long begin;
+	unsigned k;
+
+	bench_begin(&r, "throughput", "pool", threads);
+	r.ops = bench_jobs;
+	for (k = 0; k < bench_repeat; k++) {
+		latch_init(&latch, bench_jobs);
+		begin = bench_now();
+		for (i = 0; i < bench_jobs; i++)
+			tp_process_job_timed(pTp, empty_job, &latch, TP_WAIT_FOREVER);
+		latch_wait(&latch);
+		bench_run_done(&r, begin);
+	}
+	bench_report(&r);
+
+	args = (void **) malloc(TP_BATCH_SIZE * sizeof(void *));
+	for (i = 0; i < TP_BATCH_SIZE; i++)
+		args[i] = &latch;
+	bench_begin(&r, "throughput_batch", "pool", threads);
+	r.ops = bench_jobs;
+	for (k = 0; k < bench_repeat; k++) {
+		latch_init(&latch, bench_jobs);
+		begin = bench_now();
+		for (i = 0; i < bench_jobs; i += n) {
+			n = bench_jobs - i < TP_BATCH_SIZE ? bench_jobs - i : TP_BATCH_SIZE;
+			tp_process_jobs_timed(pTp, empty_job, args, n, TP_WAIT_FOREVER);
+		}
+		latch_wait(&latch);
+		bench_run_done(&r, begin);
+	}
+	bench_report(&r);
+	free(args);
+	tp_close(pTp, TRUE);
+
+	bench_begin(&r, "throughput", "pthread", threads);
+	r.ops = bench_jobs;
+	for (k = 0; k < bench_repeat; k++) {
+		latch_init(&latch, bench_jobs);
+		begin = bench_now();
+		if (spawn_jobs(empty_thread, (char *) &latch, 0, bench_jobs, threads) == 0)
+			latch_wait(&latch);
+		bench_run_done(&r, begin);
+	}
+	bench_report(&r);
+}
+
+static int cmp_ull(const void *a, const void *b) {
+	unsigned long long x = *(const unsigned long long *) a, y = *(const unsigned long long *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void bench_percentiles(BenchResult *r, BenchSample *samples, unsigned long n) {
+	unsigned long long *lat = (unsigned long long *) malloc(n * sizeof(unsigned long long));
+	unsigned long i;
+
+	for (i = 0; i < n; i++)
+		lat[i] = samples[i].start - samples[i].submit;
+	qsort(lat, n, sizeof(unsigned long long), cmp_ull);
+	r->p50 = lat[n * 50 / 100];
+	r->p90 = lat[n * 90 / 100];
+	r->p99 = lat[n * 99 / 100];
+	r->p999 = lat[n * 999 / 1000];
+	r->max = lat[n - 1];
+	free(lat);
+}
+
+static void bench_latency(unsigned threads) {
+	TpThreadPool *pTp;
+	BenchSample *samples;
+	BenchLatch latch;
+	BenchResult r;
+	pthread_t tids[BENCH_MAX_THREADS];
+	unsigned long i, j, n;
+	unsigned long long begin;
+
+	//every job is waited for, a few thousand samples are enough
+	n = bench_jobs < 10000 ? bench_jobs : 10000;
+	samples = (BenchSample *) malloc(n * sizeof(BenchSample));
+
+	pTp = bench_pool(threads);
+	bench_begin(&r, "latency", "pool", threads);
+	r.ops = n;
+	begin = bench_now();
+	for (i = 0; i < n; i += threads) {
+		latch_init(&latch, n - i < threads ? n - i : threads);
+		for (j = i; j < n && j < i + threads; j++) {
+			samples[j].latch = &latch;
+			samples[j].submit = bench_now();
+			tp_process_job_timed(pTp, sample_job, &samples[j], TP_WAIT_FOREVER);
+		}
+		latch_wait(&latch);
+	}
+	bench_run_done(&r, begin);
+	bench_percentiles(&r, samples, n);
+	bench_report(&r);
+	tp_close(pTp, TRUE);
+
+	//the thread creation is part of the latency here
+	bench_begin(&r, "latency", "pthread", threads);
+	r.ops = n;
+	begin = bench_now();
+	for (i = 0; i < n; i += threads) {
+		for (j = i; j < n && j < i + threads; j++) {
+			samples[j].submit = bench_now();
+			if (pthread_create(&tids[j - i], NULL, sample_thread, &samples[j]) != 0) {
+				fprintf(stderr, "tp_bench: pthread_create failed\n");
+				exit(1);
+			}
+		}
+		for (j = i; j < n && j < i + threads; j++)
+			pthread_join(tids[j - i], NULL);
+	}
+	bench_run_done(&r, begin);
+	bench_percentiles(&r, samples, n);
+	bench_report(&r);
+	free(samples);
+}
+
+static void bench_fanout(unsigned threads) {
+	TpThreadPool *pTp = bench_pool(threads);
+	BenchLatch latch;
+	BenchResult r;
+	void *args[BENCH_FANOUT];
+	unsigned long i, rounds = bench_jobs / BENCH_FANOUT ? bench_jobs / BENCH_FANOUT : 1;
+	unsigned long long begin;
+	unsigned j, k;
+
+	for (j = 0; j < BENCH_FANOUT; j++)
+		args[j] = &latch;
+	bench_begin(&r, "fanout", "pool", threads);
+	r.ops = rounds;
+	for (k = 0; k < bench_repeat; k++) {
+		begin = bench_now();
+		for (i = 0; i < rounds; i++) {
+			latch_init(&latch, BENCH_FANOUT);
+			tp_process_jobs_timed(pTp, empty_job, args, BENCH_FANOUT, TP_WAIT_FOREVER);
+			latch_wait(&latch);
+		}
+		bench_run_done(&r, begin);
+	}
+	bench_report(&r);
+	tp_close(pTp, TRUE);
+
+	//thread creation is slow, fewer rounds are enough
+	rounds = rounds / 16 ? rounds / 16 : 1;
+	bench_begin(&r, "fanout", "pthread", threads);
+	r.ops = rounds;
+	for (k = 0; k < bench_repeat; k++) {
+		begin = bench_now();
+		for (i = 0; i < rounds; i++) {
+			latch_init(&latch, BENCH_FANOUT);
+			if (spawn_jobs(empty_thread, (char *) &latch, 0, BENCH_FANOUT, threads) == 0)
+				latch_wait(&latch);
+		}
+		bench_run_done(&r, begin);
+	}
+	bench_report(&r);
+}
+
+static void *producer_thread(void *arg) {
+	BenchProducer *p = (BenchProducer *) arg;
+	pthread_t tid;
+	unsigned long i;
+
+	pthread_barrier_wait(p->barrier);
+	for (i = 0; i < p->jobs; i++) {
+		if (p->pool) {
+			tp_process_job_timed(p->pool, empty_job, p->latch, TP_WAIT_FOREVER);
+		} else if (pthread_create(&tid, NULL, empty_thread, p->latch) == 0) {
+			pthread_detach(tid);
+		} else {
+			//count it anyway, the waiter must not hang
+			latch_count(p->latch);
+		}
+	}
+	return NULL;
+}
+
+static void bench_contention_run(BenchResult *r, TpThreadPool *pTp, unsigned long jobs) {
+	BenchProducer p[BENCH_MAX_THREADS];
+	pthread_t tids[BENCH_MAX_THREADS];
+	pthread_barrier_t barrier;
+	BenchLatch latch;
+	unsigned long long begin;
+	unsigned j, k;
+
+	r->producers = bench_producers;
+	r->ops = jobs / bench_producers * bench_producers;
+	for (k = 0; k < bench_repeat; k++) {
+		latch_init(&latch, r->ops);
+		pthread_barrier_init(&barrier, NULL, bench_producers + 1);
+		for (j = 0; j < bench_producers; j++) {
+			p[j].pool = pTp;
+			p[j].jobs = jobs / bench_producers;
+			p[j].latch = &latch;
+			p[j].barrier = &barrier;
+			pthread_create(&tids[j], NULL, producer_thread, &p[j]);
+		}
+		//all producers start together
+		pthread_barrier_wait(&barrier);
+		begin = bench_now();
+		latch_wait(&latch);
+		bench_run_done(r, begin);
+		for (j = 0; j < bench_producers; j++)
+			pthread_join(tids[j], NULL);
+		pthread_barrier_destroy(&barrier);
+	}
+	bench_report(r);
+}
+
+static void bench_contention(unsigned threads) {
+	TpThreadPool *pTp = bench_pool(threads);
+	BenchResult r;
+
+	bench_begin(&r, "contention", "pool", threads);
+	bench_contention_run(&r, pTp, bench_jobs);
+	tp_close(pTp, TRUE);
+
+	//threads are created by the producers, threads is not used
+	bench_begin(&r, "contention", "pthread", threads);
+	bench_contention_run(&r, NULL, bench_jobs / 16);
+}
+
+//a chunk of the array for each thread created
+typedef struct {
+	long begin;
+	long end;
+} BenchChunk;
+
+static void *chunk_thread(void *arg) {
+	BenchChunk *c = (BenchChunk *) arg;
+
+	array_job(NULL, c->begin, c->end);
+	return NULL;
+}
+
+static void bench_parallel_for(unsigned threads) {
+	TpThreadPool *pTp = bench_pool(threads);
+	BenchChunk chunks[BENCH_MAX_THREADS];
+	BenchResult r;
+	unsigned long long begin;
+	unsigned j, k;
+
+	bench_begin(&r, "parallel_for", "pool", threads);
+	r.ops = BENCH_ARRAY;
+	for (k = 0; k < bench_repeat; k++) {
+		begin = bench_now();
+		tp_parallel_for(pTp, 0, BENCH_ARRAY, 0, array_job, NULL);
+		bench_run_done(&r, begin);
+	}
+	bench_report(&r);
+	tp_close(pTp, TRUE);
+
+	bench_begin(&r, "parallel_for", "pthread", threads);
+	r.ops = BENCH_ARRAY;
+	for (j = 0; j < threads; j++) {
+		chunks[j].begin = (long) BENCH_ARRAY * j / threads;
+		chunks[j].end = (long) BENCH_ARRAY * (j + 1) / threads;
+	}
+	for (k = 0; k < bench_repeat; k++) {
+		begin = bench_now();
+		spawn_jobs(chunk_thread, (char *) chunks, sizeof(BenchChunk), threads, threads);
+		bench_run_done(&r, begin);
+	}
+	bench_report(&r);
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-t threads,...] [-n jobs] [-r repeat] [-p producers] [-b bench] [-j]\n"
+			"	-t: thread numbers to run with, default 1,2,4,...,2*cpus\n"
+			"	-n: jobs of each run, default %d\n"
+			"	-r: runs of each benchmark, the best is reported, default %d\n"
+			"	-p: producers of the contention benchmark, default %d\n"
+			"	-b: throughput, latency, fanout, contention or parallel_for, default all\n"
+			"	-j: json lines instead of csv\n",
+			prog, BENCH_JOBS, BENCH_REPEAT, BENCH_PRODUCERS);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct {
+		const char *name;
+		void (*run)(unsigned threads);
+	} benches[] = {
+		{"throughput", bench_throughput},
+		{"latency", bench_latency},
+		{"fanout", bench_fanout},
+		{"contention", bench_contention},
+		{"parallel_for", bench_parallel_for},
+	};
+	unsigned threads[BENCH_MAX_THREADS];
+	unsigned thread_num = 0, i, j;
+	const char *bench = NULL;
+	char *s, *end;
+	long cpus;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:n:r:p:b:j")) != -1) {
+		switch (opt) {
+		case 't':
+			for (s = optarg; *s && thread_num < BENCH_MAX_THREADS; s = *end ? end + 1 : end) {
+				threads[thread_num] = strtoul(s, &end, 10);
+				if (end == s || !threads[thread_num] || threads[thread_num] > BENCH_MAX_THREADS)
+					usage(argv[0]);
+				thread_num++;
+			}
+			break;
+		case 'n':
+			bench_jobs = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			bench_repeat = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			bench_producers = strtoul(optarg, NULL, 10);
+			break;
+		case 'b':
+			bench = optarg;
+			break;
+		case 'j':
+			bench_json = TRUE;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!bench_jobs || !bench_repeat || !bench_producers || bench_producers > BENCH_MAX_THREADS)
+		usage(argv[0]);
+	if (!thread_num) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		for (i = 1; i <= 2 * cpus && i <= BENCH_MAX_THREADS; i *= 2)
+			threads[thread_num++] = i;
+	}
+
+	bench_array = (double *) calloc(BENCH_ARRAY, sizeof(double));
+	if (!bench_json)
+		printf("bench,impl,threads,producers,ops,ns,ops_per_sec,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+	for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+		if (bench && strcmp(bench, benches[i].name) != 0)
+			continue;
+		for (j = 0; j < thread_num; j++)
+			benches[i].run(threads[j]);
+	}
+	free(bench_array);
+
+	return 0;
+}
@@ -0,0 +1,317 @@
+/**
+ * @file tp_graph.c
+ * @version 1.0
+ * @author Tristan Lee <tristan.lee@qq.com>
+ * @brief task graph on the thread pool
+ *
+ * nodes wrap process_job callbacks, edges are dependencies between them.
+ * when a node is done, counters of the nodes depending on it are decreased,
+ * the ones ready are scheduled on the same work thread: the first one runs
+ * right there, others go to its local queue where idle threads steal them.
+ * counters are reset at every run, so a graph is built once and run again
+ * and again.
+ *
+ * Change Logs:
+ * Date			Author		Notes
+ * 2026-10-18	Tristan		the initial version
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tp_graph.h"
+
+static int tp_graph_check(TpGraph *g);
+static void tp_graph_schedule(TpGraph *g, TpGraphNode *node, int timeout);
+static void tp_graph_run_node(void *arg);
+static void tp_graph_drop_node(void *arg);
+static void tp_graph_skip(TpGraphNode *node);
+static void tp_graph_node_done(TpGraph *g);
+
+/**
+ * member function reality. create an empty task graph.
+ * para:
+ * 	pTp: thread pool the nodes run in
+ * return:
+ * 	the graph, NULL if failed
+ */
+TpGraph *tp_graph_create(TpThreadPool *pTp) {
+	TpGraph *g;
+
+	if (!pTp) return NULL;
+	g = (TpGraph *) calloc(1, sizeof(TpGraph));
+	if (!g) return NULL;
+	g->tp_pool = pTp;
+	g->checked = TRUE;
+	pthread_mutex_init(&g->lock, NULL);
+	pthread_cond_init(&g->cond, NULL);
+	return g;
+}
+
+/**
+ * member function reality. destroy the graph and all its nodes, the graph
+ * must not be running.
+ * para:
+ * 	g: the graph
+ * return:
+ */
+void tp_graph_destroy(TpGraph *g) {
+	unsigned i;
+
+	if (!g) return;
+	for (i = 0; i < g->node_num; i++) {
+		free(g->nodes[i]->succ);
+		free(g->nodes[i]);
+	}
+	free(g->nodes);
+	pthread_cond_destroy(&g->cond);
+	pthread_mutex_destroy(&g->lock);
+	free(g);
+}
+
+/**
+ * member function reality. add a node to the graph.
+ * para:
+ * 	g: the graph
+ * 	proc_fun: job of the node
+ * 	arg: job para
+ * return:
+ * 	the node, NULL if failed
+ */
+TpGraphNode *tp_graph_add_node(TpGraph *g, process_job proc_fun, void *arg) {
+	TpGraphNode *node, **nodes;
+	unsigned cap;
+
+	if (!g || !proc_fun || g->running) return NULL;
+
+	if (g->node_num == g->node_cap) {
+		cap = g->node_cap ? g->node_cap * 2 : 16;
+		nodes = (TpGraphNode **) realloc(g->nodes, cap * sizeof(TpGraphNode *));
+		if (!nodes) return NULL;
+		g->nodes = nodes;
+		g->node_cap = cap;
+	}
+
+	node = (TpGraphNode *) calloc(1, sizeof(TpGraphNode));
+	if (!node) return NULL;
+	node->proc_fun = proc_fun;
+	node->arg = arg;
+	node->graph = g;
+	g->nodes[g->node_num++] = node;
+	return node;
+}
+
+/**
+ * member function reality. add a dependency, node to runs after node from
+ * is done.
+ * para:
+ * 	g: the graph
+ * 	from: the node depended on
+ * 	to: the node depending on from
+ * return:
+ * 	0: successful; -1: failed
+ */
+int tp_graph_add_edge(TpGraph *g, TpGraphNode *from, TpGraphNode *to) {
+	TpGraphNode **succ;
+	unsigned cap;
+
+	if (!g || !from || !to || from == to || g->running) return -1;
+	if (from->graph != g || to->graph != g) return -1;
+
+	if (from->succ_num == from->succ_cap) {
+		cap = from->succ_cap ? from->succ_cap * 2 : 4;
+		succ = (TpGraphNode **) realloc(from->succ, cap * sizeof(TpGraphNode *));
+		if (!succ) return -1;
+		from->succ = succ;
+		from->succ_cap = cap;
+	}
+	from->succ[from->succ_num++] = to;
+	to->dep_num++;
+	g->checked = FALSE;
+	return 0;
+}
+
+/**
+ * member function reality. start running the graph, nodes without dependency
+ * are queued first. use tp_graph_wait() to wait until all nodes are done.
+ * para:
+ * 	g: the graph
+ * return:
+ * 	0: successful; -1: the graph is running or has a cycle
+ */
+int tp_graph_run(TpGraph *g) {
+	unsigned i;
+
+	if (!g) return -1;
+
+	pthread_mutex_lock(&g->lock);
+	if (g->running || tp_graph_check(g) != 0) {
+		pthread_mutex_unlock(&g->lock);
+		return -1;
+	}
+	if (!g->node_num) {
+		pthread_mutex_unlock(&g->lock);
+		return 0;
+	}
+	g->running = TRUE;
+	pthread_mutex_unlock(&g->lock);
+
+	for (i = 0; i < g->node_num; i++) {
+		g->nodes[i]->pending = g->nodes[i]->dep_num;
+		g->nodes[i]->skip = FALSE;
+	}
+	__atomic_store_n(&g->remaining, g->node_num, __ATOMIC_RELEASE);
+
+	for (i = 0; i < g->node_num; i++) {
+		if (!g->nodes[i]->dep_num)
+			tp_graph_schedule(g, g->nodes[i], TP_WAIT_FOREVER);
+	}
+	return 0;
+}
+
+/**
+ * member function reality. wait until all nodes of the current run are done.
+ * para:
+ * 	g: the graph
+ * 	timeout: wait time in ms, 0 - don't wait, TP_WAIT_FOREVER - wait until done
+ * return:
+ * 	0: done; -1: still running after timeout
+ */
+int tp_graph_wait(TpGraph *g, int timeout) {
+	struct timespec abs_timeout;
+	int err = 0;
+
+	if (!g) return -1;
+
+	if (timeout > 0)
+		afterms(&abs_timeout, timeout);
+
+	pthread_mutex_lock(&g->lock);
+	while (g->running && !err) {
+		if (timeout == 0)
+			err = -1;
+		else if (timeout < 0)
+			err = pthread_cond_wait(&g->cond, &g->lock);
+		else
+			err = pthread_cond_timedwait(&g->cond, &g->lock, &abs_timeout);
+	}
+	err = g->running ? -1 : 0;
+	pthread_mutex_unlock(&g->lock);
+	return err;
+}
+
+/**
+ * internal interface. check the graph has no cycle (Kahn's algorithm), only
+ * done again after the graph is changed. lock must be held.
+ */
+static int tp_graph_check(TpGraph *g) {
+	TpGraphNode **ready;
+	unsigned i, j, head = 0, tail = 0;
+
+	if (g->checked) return 0;
+
+	ready = (TpGraphNode **) malloc((g->node_num + 1) * sizeof(TpGraphNode *));
+	if (!ready) return -1;
+
+	for (i = 0; i < g->node_num; i++) {
+		g->nodes[i]->pending = g->nodes[i]->dep_num;
+		if (!g->nodes[i]->dep_num)
+			ready[tail++] = g->nodes[i];
+	}
+	while (head < tail) {
+		TpGraphNode *node = ready[head++];
+		for (j = 0; j < node->succ_num; j++) {
+			if (--node->succ[j]->pending == 0)
+				ready[tail++] = node->succ[j];
+		}
+	}
+	free(ready);
+
+	//nodes in a cycle never become ready
+	g->checked = (tail == g->node_num);
+	return g->checked ? 0 : -1;
+}
+
+/**
+ * internal interface. queue a ready node, or run it right here if it can't
+ * be queued. a node dropped by the pool is done with all nodes after it, see
+ * tp_graph_drop_node().
+ */
+static void tp_graph_schedule(TpGraph *g, TpGraphNode *node, int timeout) {
+	TpJob *job;
+
+	job = tp_job_create_ex(g->tp_pool, tp_graph_run_node, tp_graph_drop_node, 0);
+	if (job) {
+		job->arg = node;
+		if (tp_process_job_ex(g->tp_pool, job, timeout) == 0)
+			return;
+		tp_job_destroy(job);
+	}
+	tp_graph_run_node(node);
+}
+
+static void tp_graph_run_node(void *arg) {
+	TpGraphNode *node = (TpGraphNode *) arg;
+	TpGraphNode *next;
+	TpGraph *g = node->graph;
+	unsigned i;
+
+	while (node) {
+		if (!__atomic_load_n(&node->skip, __ATOMIC_RELAXED))
+			node->proc_fun(node->arg);
+
+		//the first node ready runs next on this thread, others are queued
+		//to the local queue of this thread. skipped ones are done here,
+		//the pool may be closing
+		next = NULL;
+		for (i = 0; i < node->succ_num; i++) {
+			TpGraphNode *succ = node->succ[i];
+			if (__atomic_sub_fetch(&succ->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+				if (!next)
+					next = succ;
+				else if (__atomic_load_n(&succ->skip, __ATOMIC_RELAXED))
+					tp_graph_run_node(succ);
+				else
+					tp_graph_schedule(g, succ, 0);
+			}
+		}
+
+		//g may be freed by the waiter once the last node is done, it's
+		//not touched after that since next is NULL then
+		tp_graph_node_done(g);
+		node = next;
+	}
+}
+
+/**
+ * internal interface. drop_fun of node jobs, called when the pool discards
+ * the node. nodes after it can't run either, they are done without running
+ * so the waiter isn't left waiting for them.
+ */
+static void tp_graph_drop_node(void *arg) {
+	TpGraphNode *node = (TpGraphNode *) arg;
+
+	//all of them are marked before any becomes ready
+	tp_graph_skip(node);
+	tp_graph_run_node(node);
+}
+
+//mark the node and nodes after it, the ones marked already are not walked again
+static void tp_graph_skip(TpGraphNode *node) {
+	unsigned i;
+
+	if (__atomic_exchange_n(&node->skip, TRUE, __ATOMIC_RELAXED))
+		return;
+	for (i = 0; i < node->succ_num; i++)
+		tp_graph_skip(node->succ[i]);
+}
+
+static void tp_graph_node_done(TpGraph *g) {
+	if (__atomic_sub_fetch(&g->remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+		pthread_mutex_lock(&g->lock);
+		g->running = FALSE;
+		pthread_cond_broadcast(&g->cond);
+		pthread_mutex_unlock(&g->lock);
+	}
+}
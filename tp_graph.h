@@ -0,0 +1,50 @@
+#ifndef __TP_GRAPH_H
+#define __TP_GRAPH_H
+
+#include "thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tp_graph_s TpGraph;
+typedef struct tp_graph_node_s TpGraphNode;
+
+//job node of a task graph
+struct tp_graph_node_s {
+	process_job proc_fun;
+	void *arg;
+	TpGraph *graph;
+	unsigned dep_num; //number of nodes this one depends on
+	unsigned pending; //dependencies not done yet in the current run
+	BOOL skip; //the node or one it depends on is dropped in the current run, done without running
+	TpGraphNode **succ; //nodes depending on this one
+	unsigned succ_num;
+	unsigned succ_cap;
+};
+
+//task graph, built once and run many times
+struct tp_graph_s {
+	TpThreadPool *tp_pool;
+	TpGraphNode **nodes;
+	unsigned node_num;
+	unsigned node_cap;
+	BOOL checked; //no cycle found since the last change
+	BOOL running;
+	unsigned remaining; //nodes not done yet in the current run
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+TpGraph *tp_graph_create(TpThreadPool *pTp);
+void tp_graph_destroy(TpGraph *g);
+TpGraphNode *tp_graph_add_node(TpGraph *g, process_job proc_fun, void *arg);
+int tp_graph_add_edge(TpGraph *g, TpGraphNode *from, TpGraphNode *to); //to runs after from is done
+int tp_graph_run(TpGraph *g);
+int tp_graph_wait(TpGraph *g, int timeout); //timeout in ms, TP_WAIT_FOREVER - wait until done
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,460 @@
+/**
+ * @file tp_group.c
+ * @version 1.0
+ * @author Tristan Lee <tristan.lee@qq.com>
+ * @brief pools sharing a thread budget
+ *
+ * pools created with TpAttr.group have no manage thread of their own, the
+ * group manager runs the manage round of each pool and balances threads
+ * between them. a pool always keeps its min_th_num threads, threads above
+ * it are taken from what's left of max_threads. when pools want more than
+ * that, each gets a quota by weighted max-min fairness: pools wanting less
+ * than their share get what they want, the rest split what's left by weight.
+ * a pool over its quota gives up idle threads at once, busy ones leave
+ * between jobs.
+ *
+ * Change Logs:
+ * Date			Author		Notes
+ * 2026-10-18	Tristan		the initial version
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "tp_group.h"
+
+static void *tp_group_thread(void *arg);
+static void tp_group_balance(TpGroup *g);
+static void tp_group_shed(TpGroup *g, TpThreadPool *pTp);
+static BOOL tp_group_member(TpGroup *g, TpThreadPool *pTp);
+static unsigned tp_group_budget(TpGroup *g);
+static unsigned long tp_group_now(void);
+
+/**
+ * member function reality. create a pool group and its manager thread.
+ * para:
+ * 	max_threads: threads of all pools, 0 - number of online cpus
+ * return:
+ * 	the group, NULL if failed
+ */
+TpGroup *tp_group_create(unsigned max_threads) {
+	TpGroup *g;
+	long cpus;
+
+	if (!max_threads) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		max_threads = cpus > 0 ? cpus : 1;
+	}
+	g = (TpGroup *) malloc(sizeof(TpGroup));
+	if (!g) return NULL;
+	memset(g, 0, sizeof(TpGroup));
+	pthread_mutex_init(&g->lock, NULL);
+	pthread_cond_init(&g->cond, NULL);
+	pthread_mutex_init(&g->budget_lock, NULL);
+	ts_event_init(&g->event);
+	g->max_threads = max_threads;
+	g->balance_next = tp_group_now() + TP_GROUP_INTERVAL;
+
+	if (pthread_create(&g->thread_id, NULL, tp_group_thread, g) != 0) {
+		perror("tp_group_create: pthread_create");
+		pthread_mutex_destroy(&g->budget_lock);
+		pthread_cond_destroy(&g->cond);
+		pthread_mutex_destroy(&g->lock);
+		free(g);
+		return NULL;
+	}
+	return g;
+}
+
+/**
+ * member function reality. stop the group manager and free the group.
+ * para:
+ * 	g: the group
+ * return:
+ * 	0: successful; -1: pools of the group are not closed yet
+ */
+int tp_group_destroy(TpGroup *g) {
+	if (!g) return -1;
+
+	pthread_mutex_lock(&g->lock);
+	if (g->pools) {
+		pthread_mutex_unlock(&g->lock);
+		return -1;
+	}
+	pthread_mutex_unlock(&g->lock);
+
+	__atomic_store_n(&g->stop_flag, TRUE, __ATOMIC_RELAXED);
+	ts_event_post(&g->event);
+	pthread_join(g->thread_id, NULL);
+	pthread_mutex_destroy(&g->budget_lock);
+	pthread_cond_destroy(&g->cond);
+	pthread_mutex_destroy(&g->lock);
+	free(g->snap);
+	free(g);
+	return 0;
+}
+
+/**
+ * member function reality. change the thread budget, pools over it give up
+ * threads at the next balance.
+ * para:
+ * 	g: the group
+ * 	max_threads: threads of all pools
+ * return:
+ * 	0: successful; -1: failed
+ */
+int tp_group_set_max_threads(TpGroup *g, unsigned max_threads) {
+	if (!g || !max_threads) return -1;
+
+	pthread_mutex_lock(&g->budget_lock);
+	__atomic_store_n(&g->max_threads, max_threads, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&g->budget_lock);
+	ts_event_post(&g->event);
+	return 0;
+}
+
+/**
+ * member function reality. find a pool of the group by its name.
+ * para:
+ * 	g: the group
+ * 	name: TpAttr.name of the pool
+ * return:
+ * 	the pool, NULL if not found
+ */
+TpThreadPool *tp_group_find(TpGroup *g, const char *name) {
+	TpThreadPool *pTp;
+
+	if (!g || !name) return NULL;
+
+	pthread_mutex_lock(&g->lock);
+	for (pTp = g->pools; pTp; pTp = pTp->group_next) {
+		if (strcmp(pTp->name, name) == 0)
+			break;
+	}
+	pthread_mutex_unlock(&g->lock);
+	return pTp;
+}
+
+int tp_group_get_stats(TpGroup *g, TpGroupStats *stats) {
+	TpThreadPool *pTp;
+
+	if (!g || !stats) return -1;
+
+	memset(stats, 0, sizeof(TpGroupStats));
+	pthread_mutex_lock(&g->lock);
+	pthread_mutex_lock(&g->budget_lock);
+	stats->max_threads = g->max_threads;
+	stats->reserved = g->reserved;
+	stats->pools = g->pool_num;
+	for (pTp = g->pools; pTp; pTp = pTp->group_next)
+		stats->threads += pTp->group_threads;
+	pthread_mutex_unlock(&g->budget_lock);
+	pthread_mutex_unlock(&g->lock);
+	return 0;
+}
+
+/**
+ * internal interface. add a pool to the group, after its min_th_num threads
+ * are created. its min_th_num is reserved, it may take threads above it up
+ * to max_th_num until the group is short of threads.
+ * para:
+ * 	g: the group
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	0: successful; -1: failed
+ */
+int tp_group_join(TpGroup *g, TpThreadPool *pTp) {
+	TpThreadPool **snap;
+
+	if (!g || !pTp) return -1;
+
+	pthread_mutex_lock(&g->lock);
+	//the group manager copies the list here each round
+	if (g->pool_num == g->snap_cap) {
+		snap = (TpThreadPool **) realloc(g->snap, (g->snap_cap * 2 + 4) * sizeof(TpThreadPool *));
+		if (!snap) {
+			pthread_mutex_unlock(&g->lock);
+			return -1;
+		}
+		g->snap = snap;
+		g->snap_cap = g->snap_cap * 2 + 4;
+	}
+	pthread_mutex_lock(&g->budget_lock);
+	pTp->group_threads = __atomic_load_n(&pTp->th_num, __ATOMIC_RELAXED);
+	if (pTp->group_threads > pTp->min_th_num)
+		__atomic_store_n(&g->elastic, g->elastic + (pTp->group_threads - pTp->min_th_num), __ATOMIC_RELAXED);
+	pTp->quota = pTp->max_th_num - pTp->min_th_num;
+	pTp->want = 0;
+	pTp->group_next = g->pools;
+	g->pools = pTp;
+	g->pool_num++;
+	__atomic_store_n(&g->reserved, g->reserved + pTp->min_th_num, __ATOMIC_RELAXED);
+	__atomic_store_n(&pTp->group, g, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&g->budget_lock);
+	pthread_mutex_unlock(&g->lock);
+	return 0;
+}
+
+/**
+ * internal interface. remove a pool from the group, the group manager
+ * doesn't touch it any more and its threads are out of the budget.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ */
+void tp_group_leave(TpThreadPool *pTp) {
+	TpGroup *g = pTp->group;
+	TpThreadPool **p;
+
+	if (!g) return;
+
+	pthread_mutex_lock(&g->lock);
+	for (p = &g->pools; *p; p = &(*p)->group_next) {
+		if (*p == pTp) {
+			*p = pTp->group_next;
+			break;
+		}
+	}
+	g->pool_num--;
+	//the group manager may be in the middle of a round of the pool, adding
+	//or retiring threads, so the pool is out of the budget after that
+	while (g->managing == pTp)
+		pthread_cond_wait(&g->cond, &g->lock);
+	pthread_mutex_lock(&g->budget_lock);
+	__atomic_store_n(&g->reserved, g->reserved - pTp->min_th_num, __ATOMIC_RELAXED);
+	if (pTp->group_threads > pTp->min_th_num)
+		__atomic_store_n(&g->elastic, g->elastic - (pTp->group_threads - pTp->min_th_num), __ATOMIC_RELAXED);
+	__atomic_store_n(&pTp->group_threads, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&pTp->shed_nr, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&pTp->group, NULL, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&g->budget_lock);
+	pthread_mutex_unlock(&g->lock);
+
+	//threads given up by the pool are wanted by others
+	ts_event_post(&g->event);
+}
+
+/**
+ * internal interface. take a thread from the budget for the pool.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	0: successful; -1: the pool is at its quota or the group is out of threads
+ */
+int tp_group_take(TpThreadPool *pTp) {
+	TpGroup *g = pTp->group;
+	int ret = 0;
+
+	pthread_mutex_lock(&g->budget_lock);
+	if (pTp->group_threads >= pTp->min_th_num) {
+		if (g->elastic >= tp_group_budget(g) || pTp->group_threads - pTp->min_th_num >= pTp->quota)
+			ret = -1;
+		else
+			__atomic_store_n(&g->elastic, g->elastic + 1, __ATOMIC_RELAXED);
+	}
+	if (!ret)
+		__atomic_store_n(&pTp->group_threads, pTp->group_threads + 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&g->budget_lock);
+	return ret;
+}
+
+void tp_group_put(TpThreadPool *pTp) {
+	TpGroup *g = pTp->group;
+
+	pthread_mutex_lock(&g->budget_lock);
+	__atomic_store_n(&pTp->group_threads, pTp->group_threads - 1, __ATOMIC_RELAXED);
+	if (pTp->group_threads >= pTp->min_th_num)
+		__atomic_store_n(&g->elastic, g->elastic - 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&g->budget_lock);
+}
+
+/**
+ * internal interface. check without locking if the pool may add a thread,
+ * so submitters don't wake up the group manager for nothing.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	TRUE if tp_group_take() would succeed now
+ */
+BOOL tp_group_room(TpThreadPool *pTp) {
+	TpGroup *g = __atomic_load_n(&pTp->group, __ATOMIC_ACQUIRE);
+	unsigned th;
+
+	if (!g) return TRUE;
+	th = __atomic_load_n(&pTp->group_threads, __ATOMIC_RELAXED);
+	if (th < pTp->min_th_num)
+		return TRUE;
+	return __atomic_load_n(&g->elastic, __ATOMIC_RELAXED) < tp_group_budget(g)
+		&& th - pTp->min_th_num < __atomic_load_n(&pTp->quota, __ATOMIC_RELAXED);
+}
+
+void tp_group_post(TpThreadPool *pTp) {
+	TpGroup *g = __atomic_load_n(&pTp->group, __ATOMIC_ACQUIRE);
+
+	if (g)
+		ts_event_post(&g->event);
+}
+
+/**
+ * internal interface. the group manager, runs the manage round of each pool
+ * when it's due or woken up, and balances threads every TP_GROUP_INTERVAL ms.
+ * pools are managed without the group lock, so pools can join and leave
+ * meanwhile, a pool leaving only waits for its own round.
+ */
+static void *tp_group_thread(void *arg) {
+	TpGroup *g = (TpGroup *) arg;
+	TpThreadPool *pTp;
+	struct timespec abs_timeout;
+	unsigned long now, next;
+	unsigned i, n;
+	BOOL balance;
+
+	next = tp_group_now();
+	while (1) {
+		abs_timeout.tv_sec = next / 1000;
+		abs_timeout.tv_nsec = next % 1000 * 1000000;
+		ts_event_wait_mono(&g->event, &abs_timeout);
+		if (__atomic_load_n(&g->stop_flag, __ATOMIC_RELAXED))
+			break;
+
+		pthread_mutex_lock(&g->lock);
+		now = tp_group_now();
+		balance = now >= g->balance_next;
+		if (balance) {
+			tp_group_balance(g);
+			g->balance_next = now + TP_GROUP_INTERVAL;
+		}
+		next = g->balance_next;
+		for (n = 0, pTp = g->pools; pTp; pTp = pTp->group_next)
+			g->snap[n++] = pTp;
+		pthread_mutex_unlock(&g->lock);
+
+		for (i = 0; i < n; i++) {
+			//snap may be moved by a pool joining, a pool left may be freed
+			//already, it's only compared
+			pthread_mutex_lock(&g->lock);
+			pTp = g->snap[i];
+			if (!tp_group_member(g, pTp)) {
+				pthread_mutex_unlock(&g->lock);
+				continue;
+			}
+			g->managing = pTp;
+			pthread_mutex_unlock(&g->lock);
+
+			tp_manage(pTp);
+			if (balance)
+				tp_group_shed(g, pTp);
+			if (pTp->manage_next < next)
+				next = pTp->manage_next;
+
+			pthread_mutex_lock(&g->lock);
+			g->managing = NULL;
+			pthread_cond_broadcast(&g->cond);
+			pthread_mutex_unlock(&g->lock);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * internal interface. set the quota of each pool by what it wants now, pools
+ * over their quota give up threads in their round, see tp_group_shed(). the
+ * group lock must be held.
+ */
+static void tp_group_balance(TpGroup *g) {
+	TpThreadPool *pTp;
+	unsigned budget, left, used, want, w;
+	unsigned long long want_sum = 0;
+	BOOL changed;
+
+	//threads above min_th_num each pool could use now
+	for (pTp = g->pools; pTp; pTp = pTp->group_next) {
+		want = __atomic_load_n(&pTp->busy_nr, __ATOMIC_RELAXED)
+			+ __atomic_load_n(&pTp->job_num, __ATOMIC_RELAXED)
+			+ __atomic_load_n(&pTp->reserve, __ATOMIC_RELAXED);
+		want = want > pTp->min_th_num ? want - pTp->min_th_num : 0;
+		if (want > pTp->max_th_num - pTp->min_th_num)
+			want = pTp->max_th_num - pTp->min_th_num;
+		pTp->want = want;
+		want_sum += want;
+	}
+
+	pthread_mutex_lock(&g->budget_lock);
+	budget = tp_group_budget(g);
+	if (want_sum <= budget && g->elastic <= budget) {
+		//enough for all, any pool may grow up to its max_th_num
+		for (pTp = g->pools; pTp; pTp = pTp->group_next)
+			__atomic_store_n(&pTp->quota, pTp->max_th_num - pTp->min_th_num, __ATOMIC_RELAXED);
+	} else {
+		//weighted max-min fairness, UINT_MAX marks pools not settled yet
+		for (pTp = g->pools; pTp; pTp = pTp->group_next)
+			__atomic_store_n(&pTp->quota, UINT_MAX, __ATOMIC_RELAXED);
+		left = budget;
+		do {
+			changed = FALSE;
+			w = used = 0;
+			for (pTp = g->pools; pTp; pTp = pTp->group_next) {
+				if (pTp->quota == UINT_MAX)
+					w += pTp->weight;
+			}
+			for (pTp = g->pools; pTp && w; pTp = pTp->group_next) {
+				if (pTp->quota == UINT_MAX && pTp->want <= (unsigned long long) left * pTp->weight / w) {
+					__atomic_store_n(&pTp->quota, pTp->want, __ATOMIC_RELAXED);
+					used += pTp->want;
+					changed = TRUE;
+				}
+			}
+			left -= used;
+		} while (changed);
+		for (pTp = g->pools; pTp; pTp = pTp->group_next) {
+			if (pTp->quota == UINT_MAX)
+				__atomic_store_n(&pTp->quota, (unsigned) ((unsigned long long) left * pTp->weight / w), __ATOMIC_RELAXED);
+		}
+	}
+	pthread_mutex_unlock(&g->budget_lock);
+}
+
+//make the pool give up threads over its quota, in its round
+static void tp_group_shed(TpGroup *g, TpThreadPool *pTp) {
+	unsigned elastic;
+
+	pthread_mutex_lock(&g->budget_lock);
+	elastic = pTp->group_threads > pTp->min_th_num ? pTp->group_threads - pTp->min_th_num : 0;
+	elastic = elastic > pTp->quota ? elastic - pTp->quota : 0;
+	pthread_mutex_unlock(&g->budget_lock);
+	tp_shed(pTp, elastic);
+}
+
+//the pool is still in the group, the group lock must be held
+static BOOL tp_group_member(TpGroup *g, TpThreadPool *pTp) {
+	TpThreadPool *p;
+
+	for (p = g->pools; p; p = p->group_next) {
+		if (p == pTp)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+//threads above min_th_num of all pools, lock free reading
+static unsigned tp_group_budget(TpGroup *g) {
+	unsigned max = __atomic_load_n(&g->max_threads, __ATOMIC_RELAXED);
+	unsigned reserved = __atomic_load_n(&g->reserved, __ATOMIC_RELAXED);
+
+	return max > reserved ? max - reserved : 0;
+}
+
+static unsigned long tp_group_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,63 @@
+#ifndef __TP_GROUP_H
+#define __TP_GROUP_H
+
+#include "thread_pool.h"
+
+#define TP_GROUP_INTERVAL 100	//the group manager balances threads between pools every TP_GROUP_INTERVAL ms
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tp_group_stats_s TpGroupStats;
+
+//pools sharing a thread budget, managed by one thread instead of a manage
+//thread each. every pool keeps its min_th_num, threads above it are taken
+//from the budget left, split by weight of pools when they want more than that
+struct tp_group_s {
+	pthread_mutex_t lock; //protect the pool list, not held while a pool is managed
+	pthread_cond_t cond; //signaled when the group manager is done with a pool
+	pthread_mutex_t budget_lock; //protect thread counts and quotas
+	TSEvent event; //posted to wake up the group manager
+	pthread_t thread_id;
+	BOOL stop_flag;
+	TpThreadPool *pools; //linked by group_next
+	unsigned pool_num;
+	TpThreadPool **snap; //pools of the current round, copied from the list
+	unsigned snap_cap;
+	TpThreadPool *managing; //pool being managed, leaving waits until it's done
+	unsigned max_threads; //thread budget of all pools
+	unsigned reserved; //min_th_num of all pools, granted even beyond max_threads
+	unsigned elastic; //threads above min_th_num of all pools
+	unsigned long balance_next; //next balance, in ms
+};
+
+//group statistics, see tp_group_get_stats()
+struct tp_group_stats_s {
+	unsigned max_threads;
+	unsigned reserved;
+	unsigned threads; //threads of all pools now
+	unsigned pools;
+};
+
+TpGroup *tp_group_create(unsigned max_threads); //max_threads - 0, number of online cpus. the group manager has default attributes, TpAttr of its pools doesn't apply
+int tp_group_destroy(TpGroup *g); //pools must be closed first, -1 otherwise
+int tp_group_set_max_threads(TpGroup *g, unsigned max_threads);
+TpThreadPool *tp_group_find(TpGroup *g, const char *name); //pool created with TpAttr.name
+int tp_group_get_stats(TpGroup *g, TpGroupStats *stats);
+
+int tp_group_join(TpGroup *g, TpThreadPool *pTp); //called by the pool when its min threads are created
+void tp_group_leave(TpThreadPool *pTp); //called by the pool when stopping
+int tp_group_take(TpThreadPool *pTp); //called by the pool before adding a thread, -1 if over budget
+void tp_group_put(TpThreadPool *pTp); //called by the pool when a thread is retired
+BOOL tp_group_room(TpThreadPool *pTp); //TRUE if the pool may add a thread now
+void tp_group_post(TpThreadPool *pTp); //wake up the group manager
+
+void tp_manage(TpThreadPool *pTp); //a round of the manager of the pool, implemented by the pool
+void tp_shed(TpThreadPool *pTp, unsigned n); //give up n threads above min_th_num, implemented by the pool
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
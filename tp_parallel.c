@@ -0,0 +1,228 @@
+/**
+ * @file tp_parallel.c
+ * @version 1.0
+ * @author Tristan Lee <tristan.lee@qq.com>
+ * @brief parallel for/reduce on the thread pool
+ *
+ * the range is cut into chunks of grain indexes. helper jobs and the calling
+ * thread take chunks from a shared counter until all are taken, so a slow or
+ * late thread never holds up the others, and the caller never waits for a
+ * helper which hasn't started.
+ *
+ * Change Logs:
+ * Date			Author		Notes
+ * 2026-10-18	Tristan		the initial version
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "tp_parallel.h"
+
+typedef struct tp_range_s TpRange;
+
+//shared by the caller and helper jobs, freed by the last one
+struct tp_range_s {
+	long next; //first index of the next chunk
+	long end;
+	long grain;
+	long chunks; //number of chunks
+	long done; //number of chunks done
+	range_job proc_fun;
+	reduce_job reduce_fun;
+	join_job join_fun;
+	void *arg;
+	size_t size; //size of each partial result
+	unsigned slot_num; //number of partial results
+	unsigned slot_next; //next partial result to take
+	char *partials;
+	unsigned refs;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static int tp_range_exec(TpThreadPool *pTp, long begin, long end, long grain, range_job proc_fun,
+		reduce_job reduce_fun, join_job join_fun, void *arg, void *result, size_t size);
+static void tp_range_work(TpRange *r);
+static void tp_range_run(void *arg);
+static void tp_range_release(void *arg);
+
+/**
+ * member function reality. call proc_fun on chunks of [begin, end) in the pool,
+ * the calling thread takes part and returns when all chunks are done.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	begin, end: index range
+ * 	grain: indexes per chunk, 0 - chosen by the pool parallelism
+ * 	proc_fun: called with each chunk [b, e)
+ * 	arg: user para of proc_fun
+ * return:
+ * 	0: successful; -1: failed
+ */
+int tp_parallel_for(TpThreadPool *pTp, long begin, long end, long grain, range_job proc_fun, void *arg) {
+	if (!proc_fun) return -1;
+	return tp_range_exec(pTp, begin, end, grain, proc_fun, NULL, NULL, arg, NULL, 0);
+}
+
+/**
+ * member function reality. reduce [begin, end) in the pool. each thread taking
+ * part accumulates its chunks into its own partial result, which starts as a
+ * copy of *result, the partial results are merged into *result at last. so
+ * *result must hold the identity value on entry, and join_fun must be
+ * associative and commutative.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * 	begin, end: index range
+ * 	grain: indexes per chunk, 0 - chosen by the pool parallelism
+ * 	proc_fun: accumulate chunk [b, e) into a partial result
+ * 	join_fun: merge a partial result into *result
+ * 	arg: user para of proc_fun and join_fun
+ * 	result: identity value on entry, reduction result on return
+ * 	size: size of *result
+ * return:
+ * 	0: successful; -1: failed
+ */
+int tp_parallel_reduce(TpThreadPool *pTp, long begin, long end, long grain,
+		reduce_job proc_fun, join_job join_fun, void *arg, void *result, size_t size) {
+	if (!proc_fun || !join_fun || !result || !size) return -1;
+	return tp_range_exec(pTp, begin, end, grain, NULL, proc_fun, join_fun, arg, result, size);
+}
+
+/**
+ * member function reality. number of threads a parallel loop is spread over,
+ * bounded by both max_th_num and online cpus.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	the parallelism, at least 1
+ */
+unsigned tp_get_parallelism(TpThreadPool *pTp) {
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned n = pTp->max_th_num;
+
+	if (ncpu > 0 && (unsigned long)ncpu < n)
+		n = ncpu;
+	return n ? n : 1;
+}
+
+static int tp_range_exec(TpThreadPool *pTp, long begin, long end, long grain, range_job proc_fun,
+		reduce_job reduce_fun, join_job join_fun, void *arg, void *result, size_t size) {
+	TpJob *jobs[TP_BATCH_SIZE];
+	TpRange *r;
+	unsigned i, k, helpers, queued;
+	long chunks;
+	int ret;
+
+	if (!pTp || end < begin) return -1;
+	if (end == begin) return 0;
+
+	helpers = tp_get_parallelism(pTp);
+	if (grain <= 0) {
+		grain = (end - begin) / ((long)helpers * TP_CHUNKS_PER_THREAD);
+		if (grain <= 0) grain = 1;
+	}
+	chunks = (end - begin) / grain + ((end - begin) % grain ? 1 : 0);
+
+	//the caller is one of them
+	helpers--;
+	if ((long)helpers > chunks - 1) helpers = chunks - 1;
+	if (helpers > TP_BATCH_SIZE) helpers = TP_BATCH_SIZE;
+
+	r = (TpRange *) malloc(sizeof(TpRange) + (size_t)(helpers + 1) * size);
+	if (!r) return -1;
+	r->next = begin;
+	r->end = end;
+	r->grain = grain;
+	r->chunks = chunks;
+	r->done = 0;
+	r->proc_fun = proc_fun;
+	r->reduce_fun = reduce_fun;
+	r->join_fun = join_fun;
+	r->arg = arg;
+	r->size = size;
+	r->slot_num = helpers + 1;
+	r->slot_next = 0;
+	r->partials = (char *)(r + 1);
+	for (i = 0; size && i < r->slot_num; i++)
+		memcpy(r->partials + i * size, result, size);
+	r->refs = 1 + helpers;
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->cond, NULL);
+
+	//no wait for room, the caller does the work left by helpers not queued
+	for (k = 0; k < helpers; k++) {
+		jobs[k] = tp_job_create_ex(pTp, tp_range_run, tp_range_release, 0);
+		if (!jobs[k]) break;
+		jobs[k]->arg = r;
+	}
+	ret = k ? tp_process_jobs_ex(pTp, jobs, k, 0) : 0;
+	queued = ret > 0 ? ret : 0;
+	for (i = queued; i < k; i++)
+		tp_job_destroy(jobs[i]);
+	if (queued < helpers)
+		__atomic_sub_fetch(&r->refs, helpers - queued, __ATOMIC_ACQ_REL);
+
+	tp_range_work(r);
+
+	pthread_mutex_lock(&r->lock);
+	while (__atomic_load_n(&r->done, __ATOMIC_ACQUIRE) < r->chunks)
+		pthread_cond_wait(&r->cond, &r->lock);
+	pthread_mutex_unlock(&r->lock);
+
+	//partial results not taken still hold the identity value
+	for (i = 0; reduce_fun && i < r->slot_num; i++)
+		join_fun(arg, result, r->partials + i * size);
+
+	tp_range_release(r);
+	return 0;
+}
+
+/**
+ * internal interface. take chunks until all are taken.
+ * para:
+ * 	r: the range
+ * return:
+ */
+static void tp_range_work(TpRange *r) {
+	void *partial = NULL;
+	long b, e, n = 0;
+
+	if (r->reduce_fun) {
+		//every thread taking part gets its own partial result
+		unsigned slot = __atomic_fetch_add(&r->slot_next, 1, __ATOMIC_RELAXED);
+		partial = r->partials + slot * r->size;
+	}
+
+	while ((b = __atomic_fetch_add(&r->next, r->grain, __ATOMIC_RELAXED)) < r->end) {
+		e = r->end - b > r->grain ? b + r->grain : r->end;
+		if (r->reduce_fun)
+			r->reduce_fun(r->arg, b, e, partial);
+		else
+			r->proc_fun(r->arg, b, e);
+		n++;
+	}
+
+	if (n && __atomic_add_fetch(&r->done, n, __ATOMIC_ACQ_REL) == r->chunks) {
+		pthread_mutex_lock(&r->lock);
+		pthread_cond_broadcast(&r->cond);
+		pthread_mutex_unlock(&r->lock);
+	}
+}
+
+static void tp_range_run(void *arg) {
+	tp_range_work((TpRange *) arg);
+	tp_range_release(arg);
+}
+
+static void tp_range_release(void *arg) {
+	TpRange *r = (TpRange *) arg;
+
+	if (__atomic_sub_fetch(&r->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+		pthread_cond_destroy(&r->cond);
+		pthread_mutex_destroy(&r->lock);
+		free(r);
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef __TP_PARALLEL_H
+#define __TP_PARALLEL_H
+
+#include <stddef.h>
+#include "thread_pool.h"
+
+#define TP_CHUNKS_PER_THREAD 4	//chunks per thread if grain is not given, more chunks balance the load better
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*range_job)(void *arg, long begin, long end);
+typedef void (*reduce_job)(void *arg, long begin, long end, void *partial); //accumulate [begin, end) into partial
+typedef void (*join_job)(void *arg, void *result, const void *partial); //merge partial into result
+
+int tp_parallel_for(TpThreadPool *pTp, long begin, long end, long grain, range_job proc_fun, void *arg);
+int tp_parallel_reduce(TpThreadPool *pTp, long begin, long end, long grain,
+		reduce_job proc_fun, join_job join_fun, void *arg, void *result, size_t size);
+unsigned tp_get_parallelism(TpThreadPool *pTp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
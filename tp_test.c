@@ -6,6 +6,8 @@
 #include <unistd.h>
 #include "thread_pool.h"
 #include "workpool.h"
+#include "tp_timer.h"
+#include "tp_group.h"
 
 #define THD_NUM 100 
 
@@ -72,11 +74,241 @@ int test2(void)
     return 0;
 }
 
+void *future_fun(void *arg){
+	long idx = (long) arg;
+	usleep(1000 * (rand() % 100));
+	return (void*)(idx * idx);
+}
+
+int test3(void)
+{
+	TpFuture *futures[THD_NUM];
+	void *result;
+	long i, sum = 0;
+
+	pTp = tp_create(10, THD_NUM);
+	for(i=0; i < THD_NUM; i++){
+		futures[i] = tp_process_future(pTp, future_fun, (void*)i, TP_WAIT_FOREVER);
+	}
+
+	//wait for exactly the jobs submitted, no sleep needed
+	for(i=0; i < THD_NUM; i++){
+		if(futures[i] && tp_future_wait(futures[i], &result) == 0)
+			sum += (long) result;
+		tp_future_free(futures[i]);
+	}
+	tp_close(pTp, 1);
+	fprintf(stderr, "sum of squares: %ld\n", sum);
+
+	return 0;
+}
+
+int test4(void)
+{
+    WorkPool *pool = new WorkPool;
+    std::future<long> futures[THD_NUM];
+    long i, sum = 0;
+
+    for(i=0; i < THD_NUM; i++){
+        futures[i] = pool->Submit([i]() { return i * i; });
+    }
+    for(i=0; i < THD_NUM; i++){
+        sum += futures[i].get();
+    }
+    delete pool;
+    fprintf(stderr, "sum of squares: %ld\n", sum);
+
+    return 0;
+}
+
+//slow job counting the times it has run
+void count_fun(void *arg){
+	usleep(100 * 1000);
+	__atomic_add_fetch((unsigned *) arg, 1, __ATOMIC_RELAXED);
+}
+
+int test5(void)
+{
+	unsigned done = 0;
+	int i, dropped, err;
+
+	//drain runs every job queued
+	pTp = tp_create(1, 1);
+	for(i=0; i < 10; i++){
+		tp_process_job(pTp, count_fun, &done);
+	}
+	dropped = tp_shutdown(pTp, TP_SHUTDOWN_DRAIN, 0);
+	tp_close(pTp, 1);
+	fprintf(stderr, "shutdown drain: %u done, %d dropped\n", done, dropped);
+	if(done != 10 || dropped != 0)
+		return -1;
+
+	//now drops the jobs not started, later jobs are refused
+	done = 0;
+	pTp = tp_create(1, 1);
+	for(i=0; i < 10; i++){
+		tp_process_job(pTp, count_fun, &done);
+	}
+	usleep(50 * 1000);
+	dropped = tp_shutdown(pTp, TP_SHUTDOWN_NOW, 0);
+	err = tp_process_job(pTp, count_fun, &done);
+	tp_close(pTp, 1);
+	fprintf(stderr, "shutdown now: %u done, %d dropped, submit after: %d\n", done, dropped, err);
+	if(done + dropped != 10 || dropped == 0 || err != TP_ESHUTDOWN)
+		return -1;
+
+	return 0;
+}
+
+int test6(void)
+{
+	TpCancel *c;
+	struct timespec deadline;
+	unsigned busy = 0, cancelled = 0, late = 0, kept = 0;
+
+	//the only thread is busy, so the jobs below wait in the queue
+	pTp = tp_create(1, 1);
+	tp_process_job(pTp, count_fun, &busy);
+	usleep(20 * 1000);
+
+	//cancelled before it runs
+	c = tp_cancel_create();
+	tp_process_job_cancel(pTp, count_fun, &cancelled, c, NULL, 0);
+	tp_cancel(c);
+	tp_cancel_free(c);
+
+	//past its deadline before it runs
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_nsec += 10 * 1000 * 1000;
+	if(deadline.tv_nsec >= 1000 * 1000 * 1000){
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000 * 1000 * 1000;
+	}
+	tp_process_job_cancel(pTp, count_fun, &late, NULL, &deadline, 0);
+
+	//neither, it runs
+	tp_process_job_cancel(pTp, count_fun, &kept, NULL, NULL, 0);
+
+	tp_shutdown(pTp, TP_SHUTDOWN_DRAIN, 0);
+	tp_close(pTp, 1);
+	fprintf(stderr, "cancel: cancelled %u, late %u, kept %u\n", cancelled, late, kept);
+	return cancelled == 0 && late == 0 && kept == 1 ? 0 : -1;
+}
+
+void tick_fun(void *arg){
+	__atomic_add_fetch((unsigned *) arg, 1, __ATOMIC_RELAXED);
+}
+
+int test7(void)
+{
+	TpTimer *every;
+	unsigned once = 0, ticks = 0, stopped;
+	int i;
+
+	pTp = tp_create(2, 4);
+	tp_timer_free(tp_schedule_after(pTp, tick_fun, &once, 20));
+	every = tp_schedule_every(pTp, tick_fun, &ticks, 0, 20);
+	for(i=0; i < 100 && __atomic_load_n(&ticks, __ATOMIC_RELAXED) < 5; i++){
+		usleep(20 * 1000);
+	}
+	tp_timer_cancel(every);
+
+	//no more ticks after cancelling
+	usleep(20 * 1000);
+	stopped = __atomic_load_n(&ticks, __ATOMIC_RELAXED);
+	usleep(100 * 1000);
+	fprintf(stderr, "timer: once %u, periodic %u, after cancel %u\n", once, stopped, ticks);
+	tp_close(pTp, 1);
+	return once == 1 && stopped >= 5 && ticks == stopped ? 0 : -1;
+}
+
+void self_fun(void *arg){
+	*(pthread_t *) arg = pthread_self();
+}
+
+int test8(void)
+{
+	pthread_t ran_by = 0;
+	unsigned done = 0;
+	int rejected, caller_runs;
+
+	//one job running and one pending fill the pool
+	pTp = tp_create(1, 1);
+	tp_set_queue_capacity(pTp, 1);
+	tp_process_job(pTp, count_fun, &done);
+	usleep(20 * 1000);
+	tp_process_job(pTp, count_fun, &done);
+
+	tp_set_policy(pTp, TP_POLICY_REJECT, NULL, NULL);
+	rejected = tp_process_job_timed(pTp, self_fun, &ran_by, 0);
+
+	//the submitter runs the job itself
+	tp_set_policy(pTp, TP_POLICY_CALLER_RUNS, NULL, NULL);
+	caller_runs = tp_process_job_timed(pTp, self_fun, &ran_by, 0);
+
+	tp_shutdown(pTp, TP_SHUTDOWN_DRAIN, 0);
+	tp_close(pTp, 1);
+	fprintf(stderr, "policy: reject %d, caller runs %d by %s, %u done\n", rejected, caller_runs,
+			pthread_equal(ran_by, pthread_self()) ? "caller" : "pool", done);
+	return rejected == -1 && caller_runs == 0 && pthread_equal(ran_by, pthread_self()) && done == 2 ? 0 : -1;
+}
+
+int test9(void)
+{
+	TpGroup *group;
+	TpThreadPool *pools[2];
+	TpGroupStats stats;
+	TpAttr attr;
+	unsigned done = 0, most = 0;
+	int i, j;
+
+	//two pools of up to 8 threads each share 4 threads
+	group = tp_group_create(4);
+	tp_attr_init(&attr);
+	attr.group = group;
+	attr.name = "io";
+	pools[0] = tp_create_ex(1, 8, &attr);
+	attr.name = "cpu";
+	pools[1] = tp_create_ex(1, 8, &attr);
+
+	for(i=0; i < 20; i++){
+		for(j=0; j < 2; j++)
+			tp_process_job(pools[j], count_fun, &done);
+	}
+	for(i=0; i < 100 && __atomic_load_n(&done, __ATOMIC_RELAXED) < 40; i++){
+		tp_group_get_stats(group, &stats);
+		if(stats.threads > most)
+			most = stats.threads;
+		usleep(20 * 1000);
+	}
+
+	for(j=0; j < 2; j++){
+		tp_shutdown(pools[j], TP_SHUTDOWN_DRAIN, 0);
+		tp_close(pools[j], 1);
+	}
+	fprintf(stderr, "group: %u done, at most %u threads of %u\n", done, most, stats.max_threads);
+	if(tp_group_destroy(group) != 0)
+		return -1;
+	return done == 40 && most <= 4 ? 0 : -1;
+}
+
 int main(int argc, char **argv)
 {
     //test1();
     test2();
+    test3();
+    test4();
+    if(test5() != 0)
+        fprintf(stderr, "test5 failed\n");
+    if(test6() != 0)
+        fprintf(stderr, "test6 failed\n");
+    if(test7() != 0)
+        fprintf(stderr, "test7 failed\n");
+    if(test8() != 0)
+        fprintf(stderr, "test8 failed\n");
+    if(test9() != 0)
+        fprintf(stderr, "test9 failed\n");
     
-	return 0;
+    return 0;
 }
 
@@ -0,0 +1,489 @@
+/**
+ * @file tp_timer.c
+ * @version 1.0
+ * @author Tristan Lee <tristan.lee@qq.com>
+ * @brief delayed and periodic jobs on the thread pool
+ *
+ * timers are kept in a hierarchical timer wheel of 1 ms ticks, serviced by a
+ * timer thread started with the first timer of the pool. a timer is put into
+ * the slot of its tick at the lowest level covering its distance, and moved
+ * down a level each time the lower level wraps, so adding and cancelling a
+ * timer are O(1). due timers are queued to the pool as normal jobs.
+ *
+ * Change Logs:
+ * Date			Author		Notes
+ * 2026-10-18	Tristan		the initial version
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "tp_timer.h"
+
+static TpTimerWheel *tp_wheel_get(TpThreadPool *pTp);
+static TpTimer *tp_timer_add(TpThreadPool *pTp, process_job proc_fun, void *arg,
+		unsigned long long expire_ns, unsigned period);
+static void tp_wheel_insert(TpTimerWheel *w, TpTimer *t);
+static void tp_wheel_unlink(TpTimer *t);
+static void tp_wheel_advance(TpTimerWheel *w, TpTimer **fired);
+static unsigned long long tp_wheel_next(TpTimerWheel *w);
+static void tp_timer_release(TpTimer *t);
+static void *tp_timer_thread(void *arg);
+static unsigned long long tp_timer_now(void);
+
+/**
+ * member function reality. run a job in the pool after delay ms.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ *	proc_fun: user task reality.
+ *	arg: user task para
+ *	delay: in ms
+ * return:
+ * 	the timer, released by tp_timer_cancel() or tp_timer_free(); NULL if
+ * 	failed or the pool is shutting down
+ */
+TpTimer *tp_schedule_after(TpThreadPool *pTp, process_job proc_fun, void *arg, unsigned delay) {
+	return tp_timer_add(pTp, proc_fun, arg, tp_timer_now() + delay * 1000000ULL, 0);
+}
+
+/**
+ * member function reality. run a job in the pool at abstime, at once if it's
+ * passed already.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ *	proc_fun: user task reality.
+ *	arg: user task para
+ *	abstime: CLOCK_MONOTONIC
+ * return:
+ * 	same as tp_schedule_after()
+ */
+TpTimer *tp_schedule_at(TpThreadPool *pTp, process_job proc_fun, void *arg, const struct timespec *abstime) {
+	if (!abstime) return NULL;
+	return tp_timer_add(pTp, proc_fun, arg, abstime->tv_sec * 1000000000ULL + abstime->tv_nsec, 0);
+}
+
+/**
+ * member function reality. run a job in the pool after delay ms, then every
+ * period ms until cancelled. periods missed since the pool is too busy are
+ * skipped, a job may still run while the previous one is running.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ *	proc_fun: user task reality.
+ *	arg: user task para
+ *	delay: in ms
+ *	period: in ms, > 0
+ * return:
+ * 	same as tp_schedule_after()
+ */
+TpTimer *tp_schedule_every(TpThreadPool *pTp, process_job proc_fun, void *arg, unsigned delay, unsigned period) {
+	if (!period) return NULL;
+	return tp_timer_add(pTp, proc_fun, arg, tp_timer_now() + delay * 1000000ULL, period);
+}
+
+/**
+ * member function reality. cancel the timer and release the handle. the job
+ * already queued is not affected.
+ * para:
+ * 	t: the timer
+ * return:
+ * 	0: cancelled, it won't fire any more; -1: it has fired or been stopped
+ */
+int tp_timer_cancel(TpTimer *t) {
+	TpTimerWheel *w;
+	int ret = -1;
+
+	if (!t) return -1;
+
+	w = t->wheel;
+	pthread_mutex_lock(&w->lock);
+	if (t->state == TP_TIMER_PENDING) {
+		tp_wheel_unlink(t);
+		w->count--;
+		t->state = TP_TIMER_DONE;
+		__atomic_sub_fetch(&t->refs, 1, __ATOMIC_RELAXED); //the wheel doesn't hold it any more
+		ret = 0;
+	} else if (t->state == TP_TIMER_FIRING && t->period) {
+		//the timer thread drops it instead of adding it again
+		t->state = TP_TIMER_DONE;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	tp_timer_free(t);
+	return ret;
+}
+
+/**
+ * member function reality. release the handle, the timer fires as before.
+ * neither the timer nor the handle may be used any more.
+ * para:
+ * 	t: the timer
+ * return:
+ */
+void tp_timer_free(TpTimer *t) {
+	if (t)
+		tp_timer_release(t);
+}
+
+/**
+ * member function reality. stop the timer thread, timers not fired are
+ * dropped. called by the pool, jobs are not accepted any more.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ */
+void tp_timer_stop(TpThreadPool *pTp) {
+	TpTimerWheel *w = __atomic_load_n(&pTp->timer, __ATOMIC_ACQUIRE);
+	TpTimer *t, *list = NULL;
+	unsigned i, j;
+
+	if (!w) return;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->stop_flag) {
+		pthread_mutex_unlock(&w->lock);
+		return;
+	}
+	w->stop_flag = TRUE;
+	for (i = 0; i < TP_WHEEL_LEVELS; i++) {
+		for (j = 0; j < TP_WHEEL_SIZE; j++) {
+			while ((t = w->slot[i][j]) != NULL) {
+				tp_wheel_unlink(t);
+				t->state = TP_TIMER_DONE;
+				t->next = list;
+				list = t;
+			}
+		}
+	}
+	w->count = 0;
+	pthread_mutex_unlock(&w->lock);
+
+	ts_event_post(&w->event);
+	pthread_join(w->thread_id, NULL);
+
+	while ((t = list) != NULL) {
+		list = t->next;
+		tp_timer_release(t);
+	}
+}
+
+/**
+ * member function reality. free the timer wheel, called by the pool after
+ * tp_timer_stop(). handles of timers must be released before.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ */
+void tp_timer_destroy(TpThreadPool *pTp) {
+	TpTimerWheel *w = pTp->timer;
+
+	if (!w) return;
+	pthread_mutex_destroy(&w->lock);
+	free(w);
+	pTp->timer = NULL;
+}
+
+/**
+ * internal interface. get the timer wheel of the pool, it's created and the
+ * timer thread is started for the first timer.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ * return:
+ * 	the timer wheel, NULL if failed or the pool is shutting down
+ */
+static TpTimerWheel *tp_wheel_get(TpThreadPool *pTp) {
+	TpTimerWheel *w = __atomic_load_n(&pTp->timer, __ATOMIC_ACQUIRE);
+	pthread_attr_t attr;
+	int err;
+
+	if (w) return w;
+
+	//job_lock keeps it from racing with another creator and tp_shutdown()
+	pthread_mutex_lock(&pTp->job_lock);
+	w = pTp->timer;
+	if (!w && !pTp->shutdown) {
+		w = (TpTimerWheel *) calloc(1, sizeof(TpTimerWheel));
+		if (w) {
+			w->tp_pool = pTp;
+			pthread_mutex_init(&w->lock, NULL);
+			ts_event_init(&w->event);
+			w->stop_flag = FALSE;
+			w->base_ns = tp_timer_now();
+			w->cur = 0;
+			w->wake = ~0ULL;
+			w->count = 0;
+			//same stack, guard and cpus as the manage thread
+			tp_thread_attr(pTp, NULL, &attr);
+			err = pthread_create(&w->thread_id, &attr, tp_timer_thread, w);
+			pthread_attr_destroy(&attr);
+			if (err != 0) {
+				fprintf(stderr, "tp_wheel_get: create timer thread failed\n");
+				pthread_mutex_destroy(&w->lock);
+				free(w);
+				w = NULL;
+			} else {
+				__atomic_store_n(&pTp->timer, w, __ATOMIC_RELEASE);
+			}
+		}
+	}
+	pthread_mutex_unlock(&pTp->job_lock);
+	return w;
+}
+
+/**
+ * internal interface. create a timer and put it into the wheel.
+ * para:
+ * 	pTp: thread pool struct instance ponter
+ *	proc_fun: user task reality.
+ *	arg: user task para
+ *	expire_ns: CLOCK_MONOTONIC time to fire at
+ *	period: in ms, 0 - fire once
+ * return:
+ * 	the timer, NULL if failed
+ */
+static TpTimer *tp_timer_add(TpThreadPool *pTp, process_job proc_fun, void *arg,
+		unsigned long long expire_ns, unsigned period) {
+	TpTimerWheel *w;
+	TpTimer *t;
+	BOOL post = FALSE;
+
+	if (!pTp || !proc_fun) return NULL;
+	if (__atomic_load_n(&pTp->shutdown, __ATOMIC_RELAXED)) return NULL;
+	w = tp_wheel_get(pTp);
+	if (!w) return NULL;
+
+	t = (TpTimer *) malloc(sizeof(TpTimer));
+	if (!t) return NULL;
+	t->proc_fun = proc_fun;
+	t->arg = arg;
+	t->period = period;
+	t->state = TP_TIMER_PENDING;
+	t->retry = FALSE;
+	t->refs = 2;
+	t->wheel = w;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->stop_flag) {
+		pthread_mutex_unlock(&w->lock);
+		free(t);
+		return NULL;
+	}
+	//the wheel is empty, the timer thread may have slept for long
+	if (!w->count)
+		w->cur = (tp_timer_now() - w->base_ns) / 1000000;
+	//round up, a timer never fires early
+	t->expire = expire_ns > w->base_ns ? (expire_ns - w->base_ns + 999999) / 1000000 : 0;
+	tp_wheel_insert(w, t);
+	w->count++;
+	if (t->expire < w->wake) {
+		//the timer thread sleeps longer than this timer
+		w->wake = t->expire;
+		post = TRUE;
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	if (post)
+		ts_event_post(&w->event);
+	return t;
+}
+
+/**
+ * internal interface. put a timer into the slot of its tick at the lowest
+ * level covering its distance. a timer due already goes to the next tick.
+ */
+static void tp_wheel_insert(TpTimerWheel *w, TpTimer *t) {
+	unsigned long long expire = t->expire, delta;
+	unsigned level, idx;
+
+	if (expire <= w->cur)
+		expire = w->cur + 1;
+	delta = expire - w->cur;
+	for (level = 0; level < TP_WHEEL_LEVELS - 1; level++) {
+		if (delta < 1ULL << (TP_WHEEL_BITS * (level + 1)))
+			break;
+	}
+	//a timer beyond the top level waits at its end and is placed again
+	if (delta >= 1ULL << (TP_WHEEL_BITS * TP_WHEEL_LEVELS))
+		expire = w->cur + (1ULL << (TP_WHEEL_BITS * TP_WHEEL_LEVELS)) - 1;
+	idx = (expire >> (TP_WHEEL_BITS * level)) & (TP_WHEEL_SIZE - 1);
+
+	t->next = w->slot[level][idx];
+	if (t->next)
+		t->next->pprev = &t->next;
+	t->pprev = &w->slot[level][idx];
+	w->slot[level][idx] = t;
+}
+
+static void tp_wheel_unlink(TpTimer *t) {
+	*t->pprev = t->next;
+	if (t->next)
+		t->next->pprev = t->pprev;
+	t->next = NULL;
+	t->pprev = NULL;
+}
+
+/**
+ * internal interface. process the next tick, timers of higher levels are
+ * moved down when lower levels wrap, due timers are added to fired.
+ */
+static void tp_wheel_advance(TpTimerWheel *w, TpTimer **fired) {
+	TpTimer *t, *list;
+	unsigned level, idx;
+
+	w->cur++;
+	for (level = 1; level < TP_WHEEL_LEVELS; level++) {
+		//lower level not wrapped
+		if (w->cur & ((1ULL << (TP_WHEEL_BITS * level)) - 1))
+			break;
+		idx = (w->cur >> (TP_WHEEL_BITS * level)) & (TP_WHEEL_SIZE - 1);
+		list = w->slot[level][idx];
+		w->slot[level][idx] = NULL;
+		while ((t = list) != NULL) {
+			list = t->next;
+			tp_wheel_insert(w, t);
+		}
+	}
+
+	idx = w->cur & (TP_WHEEL_SIZE - 1);
+	list = w->slot[0][idx];
+	w->slot[0][idx] = NULL;
+	while ((t = list) != NULL) {
+		list = t->next;
+		if (t->expire > w->cur) {
+			//beyond the top level when added
+			tp_wheel_insert(w, t);
+			continue;
+		}
+		w->count--;
+		t->state = TP_TIMER_FIRING;
+		t->pprev = NULL;
+		t->next = *fired;
+		*fired = t;
+	}
+}
+
+/**
+ * internal interface. find the tick the timer thread should wake up at, the
+ * next non-empty slot of level 0, or the tick level 0 wraps to move timers
+ * down.
+ * return:
+ * 	the tick, ~0 if no timer is pending
+ */
+static unsigned long long tp_wheel_next(TpTimerWheel *w) {
+	unsigned long long tick;
+
+	if (!w->count)
+		return ~0ULL;
+	for (tick = w->cur + 1; tick & (TP_WHEEL_SIZE - 1); tick++) {
+		if (w->slot[0][tick & (TP_WHEEL_SIZE - 1)])
+			return tick;
+	}
+	return tick;
+}
+
+static void tp_timer_release(TpTimer *t) {
+	if (__atomic_sub_fetch(&t->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		free(t);
+}
+
+/**
+ * internal interface. the timer thread, queue due timers to the pool and
+ * sleep until the next one.
+ * para:
+ * 	arg: the timer wheel
+ * return:
+ */
+static void *tp_timer_thread(void *arg) {
+	TpTimerWheel *w = (TpTimerWheel *) arg;
+	TpThreadPool *pTp = w->tp_pool;
+	TpTimer *t, *fired;
+	TpJob *job;
+	unsigned long long now, tick;
+	struct timespec abstime;
+	BOOL full;
+	int err;
+
+	tp_thread_setup(pTp, NULL, "t");
+
+	pthread_mutex_lock(&w->lock);
+	while (!w->stop_flag) {
+		now = (tp_timer_now() - w->base_ns) / 1000000;
+		fired = NULL;
+		if (!w->count && w->cur < now)
+			w->cur = now;
+		while (w->cur < now)
+			tp_wheel_advance(w, &fired);
+
+		if (fired) {
+			//a full pending job queue doesn't hold up other timers, jobs it
+			//can't take are tried again at the next tick. the saturation
+			//policy of the pool still applies after the short wait
+			pthread_mutex_unlock(&w->lock);
+			full = FALSE;
+			for (t = fired; t; t = t->next) {
+				t->retry = full;
+				if (full) continue;
+				job = tp_job_create_ex(pTp, t->proc_fun, NULL, 0);
+				if (!job) continue;
+				job->arg = t->arg;
+				err = tp_process_job_ex(pTp, job, TP_TIMER_SUBMIT_TIMEOUT);
+				if (err != 0) {
+					tp_job_destroy(job);
+					if (err != TP_ESHUTDOWN)
+						t->retry = full = TRUE;
+				}
+			}
+			pthread_mutex_lock(&w->lock);
+			while ((t = fired) != NULL) {
+				fired = t->next;
+				if (t->state == TP_TIMER_FIRING && t->retry && !w->stop_flag) {
+					t->expire = w->cur + 1;
+					t->state = TP_TIMER_PENDING;
+					tp_wheel_insert(w, t);
+					w->count++;
+				} else if (t->state == TP_TIMER_FIRING && t->period && !w->stop_flag) {
+					//skip periods missed
+					t->expire += t->period;
+					if (t->expire <= w->cur)
+						t->expire += (w->cur - t->expire) / t->period * t->period + t->period;
+					t->state = TP_TIMER_PENDING;
+					tp_wheel_insert(w, t);
+					w->count++;
+				} else {
+					t->state = TP_TIMER_DONE;
+					tp_timer_release(t);
+				}
+			}
+			continue;
+		}
+
+		tick = tp_wheel_next(w);
+		w->wake = tick;
+		pthread_mutex_unlock(&w->lock);
+		if (tick == ~0ULL) {
+			ts_event_wait_mono(&w->event, NULL);
+		} else {
+			now = w->base_ns + tick * 1000000;
+			abstime.tv_sec = now / 1000000000;
+			abstime.tv_nsec = now % 1000000000;
+			ts_event_wait_mono(&w->event, &abstime);
+		}
+		pthread_mutex_lock(&w->lock);
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	return NULL;
+}
+
+static unsigned long long tp_timer_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
@@ -0,0 +1,65 @@
+#ifndef __TP_TIMER_H
+#define __TP_TIMER_H
+
+#include "thread_pool.h"
+
+#define TP_WHEEL_BITS 8	//each level of the timer wheel has 2^TP_WHEEL_BITS slots
+#define TP_WHEEL_SIZE (1 << TP_WHEEL_BITS)
+#define TP_WHEEL_LEVELS 4	//timers up to 2^(TP_WHEEL_BITS*TP_WHEEL_LEVELS) ms away are placed directly, about 49 days
+#define TP_TIMER_PENDING 0	//timer state, waiting in the wheel
+#define TP_TIMER_FIRING 1	//timer state, its job is being queued
+#define TP_TIMER_DONE 2	//timer state, fired or cancelled, never fires again
+#define TP_TIMER_SUBMIT_TIMEOUT 1	//ms a due job waits for room in the pending job queue, it's tried again at the next tick if still full
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tp_timer_s TpTimer;
+
+//a job scheduled by tp_schedule_*()
+struct tp_timer_s {
+	process_job proc_fun;
+	void *arg;
+	unsigned long long expire; //tick to fire at, in ms since the wheel started
+	unsigned period; //in ms, 0 - fire once
+	unsigned state; //TP_TIMER_*, protected by the wheel lock
+	BOOL retry; //its job couldn't be queued, touched by the timer thread only
+	unsigned refs; //the handle and the wheel
+	TpTimerWheel *wheel;
+	TpTimer *next; //in a slot of the wheel, or in the list being fired
+	TpTimer **pprev; //points to the pointer to this timer in the slot
+};
+
+//hierarchical timer wheel of 1 ms ticks, a timer is placed at the level its
+//distance fits, and moved down a level each time the lower level wraps
+struct tp_timer_wheel_s {
+	TpThreadPool *tp_pool;
+	pthread_mutex_t lock; //protect the wheel and states of timers
+	TSEvent event; //posted when a timer is due before the timer thread wakes up
+	pthread_t thread_id;
+	BOOL stop_flag;
+	unsigned long long base_ns; //CLOCK_MONOTONIC time of tick 0
+	unsigned long long cur; //last tick processed
+	unsigned long long wake; //tick the timer thread wakes up at, ~0 - sleeps until posted
+	unsigned long count; //timers in the wheel
+	TpTimer *slot[TP_WHEEL_LEVELS][TP_WHEEL_SIZE];
+};
+
+TpTimer *tp_schedule_after(TpThreadPool *pTp, process_job proc_fun, void *arg, unsigned delay); //delay in ms
+TpTimer *tp_schedule_at(TpThreadPool *pTp, process_job proc_fun, void *arg, const struct timespec *abstime); //abstime - CLOCK_MONOTONIC
+TpTimer *tp_schedule_every(TpThreadPool *pTp, process_job proc_fun, void *arg, unsigned delay, unsigned period); //first after delay, then every period ms
+int tp_timer_cancel(TpTimer *t); //cancel and release the handle, return 0 if cancelled, -1 if fired or stopped already
+void tp_timer_free(TpTimer *t); //release the handle, the timer still fires
+
+void tp_timer_stop(TpThreadPool *pTp); //called by the pool when stopping
+void tp_timer_destroy(TpThreadPool *pTp); //called by the pool when freed
+
+void tp_thread_attr(TpThreadPool *pTp, TpThreadInfo *pThi, pthread_attr_t *attr); //attributes by TpAttr, implemented by the pool
+void tp_thread_setup(TpThreadPool *pTp, TpThreadInfo *pThi, const char *role); //name the calling thread, implemented by the pool
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
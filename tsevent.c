@@ -0,0 +1,126 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  tsevent.c
+ *
+ *    Description:  it's a counting event for one waiter and many posters, the
+ *                  waiter may spin on it for a while before sleeping on a futex.
+ *                  posters only make the futex syscall when the waiter sleeps,
+ *                  an event posted to a spinning waiter costs an atomic add.
+ *
+ *        Version:  1.0
+ *        Created:  10/18/2026 04:12:09 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Tristan Lee
+ *   Organization:  gw
+ *
+ * =====================================================================================
+ */
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "tsevent.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+#define ts_cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define ts_cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define ts_cpu_relax() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#endif
+
+static int ts_event_wait_clock(TSEvent *ev, const struct timespec *abstime, int clock);
+
+void ts_event_init(TSEvent *ev){
+	ev->value = 0;
+}
+
+void ts_event_post(TSEvent *ev){
+	//ev is not touched after the add, the waiter may free it once the
+	//event is taken. waking a freed private futex does no harm
+	if(__atomic_fetch_add(&ev->value, 1, __ATOMIC_RELEASE) & TS_EVENT_SLEEPING)
+		syscall(SYS_futex, &ev->value, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+BOOL ts_event_trywait(TSEvent *ev){
+	unsigned v = __atomic_load_n(&ev->value, __ATOMIC_RELAXED);
+
+	while(v & ~TS_EVENT_SLEEPING){
+		//there's only one waiter, it's awake now
+		if(__atomic_compare_exchange_n(&ev->value, &v, (v - 1) & ~TS_EVENT_SLEEPING,
+					TRUE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/**
+ * poll the event spin times, then yield the cpu a few times.
+ * return TRUE if an event is taken, FALSE if the caller should sleep.
+ */
+BOOL ts_event_spin(TSEvent *ev, unsigned spin){
+	unsigned i;
+
+	if(!spin)
+		return ts_event_trywait(ev);
+
+	for(i = 0; i < spin; i++){
+		if((__atomic_load_n(&ev->value, __ATOMIC_RELAXED) & ~TS_EVENT_SLEEPING)
+				&& ts_event_trywait(ev))
+			return TRUE;
+		ts_cpu_relax();
+	}
+	for(i = 0; i < TS_EVENT_YIELDS; i++){
+		if(ts_event_trywait(ev))
+			return TRUE;
+		sched_yield();
+	}
+	return ts_event_trywait(ev);
+}
+
+/**
+ * sleep until an event is posted or abstime (CLOCK_REALTIME, NULL - forever)
+ * is reached. return 0 if an event is taken, -1 on timeout.
+ */
+int ts_event_wait(TSEvent *ev, const struct timespec *abstime){
+	return ts_event_wait_clock(ev, abstime, FUTEX_CLOCK_REALTIME);
+}
+
+/**
+ * same as ts_event_wait(), abstime is CLOCK_MONOTONIC, not affected by
+ * changes of the system time.
+ */
+int ts_event_wait_mono(TSEvent *ev, const struct timespec *abstime){
+	return ts_event_wait_clock(ev, abstime, 0);
+}
+
+static int ts_event_wait_clock(TSEvent *ev, const struct timespec *abstime, int clock){
+	unsigned v;
+
+	while(!ts_event_trywait(ev)){
+		//tell posters to wake us up, then sleep only if nothing is posted
+		//in between, otherwise the futex returns EAGAIN at once
+		v = 0;
+		if(!__atomic_compare_exchange_n(&ev->value, &v, TS_EVENT_SLEEPING,
+					FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED) && v != TS_EVENT_SLEEPING)
+			continue;
+		if(!abstime){
+			syscall(SYS_futex, &ev->value, FUTEX_WAIT_PRIVATE, TS_EVENT_SLEEPING, NULL, NULL, 0);
+			continue;
+		}
+		if(syscall(SYS_futex, &ev->value, FUTEX_WAIT_BITSET_PRIVATE | clock,
+					TS_EVENT_SLEEPING, abstime, NULL, FUTEX_BITSET_MATCH_ANY) == -1
+				&& errno == ETIMEDOUT){
+			//clear the flag unless an event came meanwhile
+			v = TS_EVENT_SLEEPING;
+			if(__atomic_compare_exchange_n(&ev->value, &v, 0,
+						FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				return -1;
+		}
+	}
+	return 0;
+}
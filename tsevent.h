@@ -0,0 +1,65 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  tsevent.h
+ *
+ *    Description:  it's a counting event for one waiter and many posters, the
+ *                  waiter may spin on it for a while before sleeping on a futex
+ *
+ *        Version:  1.0
+ *        Created:  10/18/2026 04:12:09 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Tristan Lee
+ *   Organization:  gw
+ *
+ * =====================================================================================
+ */
+
+#ifndef B_TS_EVENT_H__
+#define B_TS_EVENT_H__
+
+#include <time.h>
+
+#ifndef BOOL
+#define BOOL int
+#endif
+
+#ifndef TRUE
+#define TRUE 1
+#endif 
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#ifndef TS_EVENT_YIELDS
+#define TS_EVENT_YIELDS 4 //sched_yield() times after spinning, before sleeping
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ts_event TSEvent;
+
+#define TS_EVENT_SLEEPING 0x80000000u //flag in value, the waiter sleeps on the futex
+
+struct ts_event{
+	unsigned value; //events posted but not waited yet and TS_EVENT_SLEEPING, the futex word
+};
+
+void ts_event_init(TSEvent *ev);
+
+void ts_event_post(TSEvent *ev);
+BOOL ts_event_trywait(TSEvent *ev);
+BOOL ts_event_spin(TSEvent *ev, unsigned spin);
+int ts_event_wait(TSEvent *ev, const struct timespec *abstime);
+int ts_event_wait_mono(TSEvent *ev, const struct timespec *abstime);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
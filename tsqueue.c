@@ -21,8 +21,8 @@
 
 
 static void ts_queue_init(TSQueue *cq);
-//static TSQItem *ts_queue_item_new(TSQueue *cq);
-//static void ts_queue_item_free(TSQueue *cq, TSQItem *item);
+static TSQItem *ts_queue_item_new(TSQueue *cq);
+static void ts_queue_item_free(TSQueue *cq, TSQItem *item);
 
 static TSQItem *ts_queue_head(TSQueue *cq);
 static TSQItem *ts_queue_tail(TSQueue *cq);
@@ -42,22 +42,27 @@ void ts_queue_destroy(TSQueue *cq){
 		return;
 
     while (!ts_queue_is_empty(cq)) ts_queue_deq_data(cq);
+	while (cq->free) {
+		TSQItem *item = cq->free;
+		cq->free = item->next;
+		free(item);
+	}
 	pthread_mutex_destroy(&cq->lock);
 	free(cq);
 }
 
 void *ts_queue_deq_data(TSQueue *cq){
-	void *data;
+	void *data = NULL;
 	TSQItem *item;
 	if(!cq)
 		return NULL;
+	pthread_mutex_lock(&cq->lock);
 	item = ts_queue_deq(cq);
-	if(!item){
-		//
-		return NULL;
+	if(item){
+		data = item->data;
+		ts_queue_item_free(cq, item);
 	}
-	data = item->data;
-	free(item);
+	pthread_mutex_unlock(&cq->lock);
 	return data;
 }
 
@@ -66,13 +71,16 @@ int ts_queue_enq_data(TSQueue *cq, void *data){
 	if(!cq || !data)
 		return -1;
 
-    item = (TSQItem *) malloc(sizeof(TSQItem));
+	pthread_mutex_lock(&cq->lock);
+	item = ts_queue_item_new(cq);
 	if(!item){
 		//perror("ts_queue_push_data");
+		pthread_mutex_unlock(&cq->lock);
 		return -1;
 	}
 	item->data = data;
 	ts_queue_enq(cq, item);
+	pthread_mutex_unlock(&cq->lock);
 	return 0;
 }
 
@@ -94,6 +102,7 @@ void *ts_queue_rm_data(TSQueue *cq, void *data){
             item->next = NULL;
             if (item == cq->tail) cq->tail = prev;
             cq->count--;
+            ts_queue_item_free(cq, item);
             break;                
         }
         prev = *p;
@@ -101,12 +110,7 @@ void *ts_queue_rm_data(TSQueue *cq, void *data){
     }
     pthread_mutex_unlock(&cq->lock);
     
-    if (item) {
-        free(item);
-        return data;
-    }
-
-    return NULL;
+    return item ? data : NULL;
 }
 
 unsigned ts_queue_count(TSQueue *cq){
@@ -130,6 +134,31 @@ static void ts_queue_init(TSQueue *cq){
 	cq->head = NULL;
 	cq->tail = NULL;
 	cq->count = 0;
+	cq->free = NULL;
+	cq->free_count = 0;
+}
+
+//lock must be held, items are reused before malloc
+static TSQItem *ts_queue_item_new(TSQueue *cq){
+	TSQItem *item = cq->free;
+
+	if(item){
+		cq->free = item->next;
+		cq->free_count--;
+		return item;
+	}
+	return (TSQItem *) malloc(sizeof(TSQItem));
+}
+
+//lock must be held
+static void ts_queue_item_free(TSQueue *cq, TSQItem *item){
+	if(cq->free_count >= TS_QUEUE_FREE_MAX){
+		free(item);
+		return;
+	}
+	item->next = cq->free;
+	cq->free = item;
+	cq->free_count++;
 }
 
 static TSQItem *ts_queue_head(TSQueue *cq){
@@ -150,12 +179,12 @@ static TSQItem *ts_queue_peek(TSQueue *cq){
 	return ts_queue_head(cq);
 }
 
+//lock must be held
 static TSQItem *ts_queue_deq(TSQueue *cq){
 	TSQItem *item;
 	if(!cq)
 		return NULL;
 
-	pthread_mutex_lock(&cq->lock);
 	item = cq->head;
 	if(NULL != item){
 		cq->head = item->next;
@@ -163,22 +192,20 @@ static TSQItem *ts_queue_deq(TSQueue *cq){
 			cq->tail = NULL;
 		cq->count--;
 	}
-	pthread_mutex_unlock(&cq->lock);
 
 	return item;
 }
 
+//lock must be held
 static void ts_queue_enq(TSQueue *cq, TSQItem *item) {
 	if(!cq || !item)
 		return;
 	item->next = NULL;
-	pthread_mutex_lock(&cq->lock);
 	if (NULL == cq->tail)
 		cq->head = item;
 	else
 		cq->tail->next = item;
 	cq->tail = item;
 	cq->count++;
-	pthread_mutex_unlock(&cq->lock);
 }
 
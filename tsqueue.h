@@ -31,6 +31,8 @@
 #define FALSE 0
 #endif
 
+#define TS_QUEUE_FREE_MAX 1024	//items kept for reuse, the rest are freed
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -50,6 +52,8 @@ struct ts_queue{
 	pthread_mutex_t lock;
 		
 	unsigned count;
+	TSQItem *free; //items dequeued, kept for reuse
+	unsigned free_count;
 };
 
 TSQueue *ts_queue_create();
@@ -0,0 +1,133 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  tsring.c
+ *
+ *    Description:  it's a bounded lock free multi-producer/multi-consumer queue,
+ *                  items are kept in a ring buffer allocated at creation. each
+ *                  cell has a sequence number telling producers and consumers
+ *                  whether it's free or filled, so only head or tail is contended.
+ *
+ *        Version:  1.0
+ *        Created:  10/18/2026 02:26:31 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Tristan Lee
+ *   Organization:  gw
+ *
+ * =====================================================================================
+ */
+#include <stdlib.h>
+#include "tsring.h"
+
+TSRing *ts_ring_create(unsigned size){
+	TSRing *rq;
+	unsigned long i, n = 2;
+
+	if(!size)
+		return NULL;
+	while(n < size)
+		n <<= 1;
+
+	rq = (TSRing *) calloc(1, sizeof(TSRing));
+	if(!rq)
+		return NULL;
+	rq->cells = (TSRingCell *) malloc(n * sizeof(TSRingCell));
+	if(!rq->cells){
+		free(rq);
+		return NULL;
+	}
+	for(i = 0; i < n; i++){
+		rq->cells[i].seq = i;
+		rq->cells[i].data = NULL;
+	}
+	rq->mask = n - 1;
+	rq->head = 0;
+	rq->tail = 0;
+	return rq;
+}
+
+void ts_ring_destroy(TSRing *rq){
+	if(!rq)
+		return;
+	free(rq->cells);
+	free(rq);
+}
+
+int ts_ring_enq_data(TSRing *rq, void *data){
+	TSRingCell *cell;
+	unsigned long pos, seq;
+	long dif;
+
+	if(!rq || !data)
+		return -1;
+
+	pos = __atomic_load_n(&rq->tail, __ATOMIC_RELAXED);
+	while(1){
+		cell = &rq->cells[pos & rq->mask];
+		seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		dif = (long)seq - (long)pos;
+		if(dif == 0){
+			if(__atomic_compare_exchange_n(&rq->tail, &pos, pos + 1, 1,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if(dif < 0){
+			return -1; //full
+		}
+		else{
+			pos = __atomic_load_n(&rq->tail, __ATOMIC_RELAXED);
+		}
+	}
+
+	cell->data = data;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void *ts_ring_deq_data(TSRing *rq){
+	TSRingCell *cell;
+	unsigned long pos, seq;
+	long dif;
+	void *data;
+
+	if(!rq)
+		return NULL;
+
+	pos = __atomic_load_n(&rq->head, __ATOMIC_RELAXED);
+	while(1){
+		cell = &rq->cells[pos & rq->mask];
+		seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		dif = (long)seq - (long)(pos + 1);
+		if(dif == 0){
+			if(__atomic_compare_exchange_n(&rq->head, &pos, pos + 1, 1,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if(dif < 0){
+			return NULL; //empty
+		}
+		else{
+			pos = __atomic_load_n(&rq->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	data = cell->data;
+	__atomic_store_n(&cell->seq, pos + rq->mask + 1, __ATOMIC_RELEASE);
+	return data;
+}
+
+unsigned ts_ring_count(TSRing *rq){
+	unsigned long head, tail;
+
+	if(!rq)
+		return 0;
+	head = __atomic_load_n(&rq->head, __ATOMIC_ACQUIRE);
+	tail = __atomic_load_n(&rq->tail, __ATOMIC_ACQUIRE);
+	return tail > head ? (unsigned)(tail - head) : 0;
+}
+
+BOOL ts_ring_is_empty(TSRing *rq){
+	return ts_ring_count(rq)? FALSE : TRUE;
+}
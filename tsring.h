@@ -0,0 +1,74 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  tsring.h
+ *
+ *    Description:  it's a bounded lock free multi-producer/multi-consumer queue,
+ *                  items are kept in a ring buffer allocated at creation
+ *
+ *        Version:  1.0
+ *        Created:  10/18/2026 02:26:31 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Tristan Lee
+ *   Organization:  gw
+ *
+ * =====================================================================================
+ */
+
+#ifndef B_TS_RING_H__
+#define B_TS_RING_H__
+
+#ifndef BOOL
+#define BOOL int
+#endif
+
+#ifndef TRUE
+#define TRUE 1
+#endif 
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#ifndef TS_CACHE_LINE
+#define TS_CACHE_LINE 64
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ts_ring_cell TSRingCell;
+
+struct ts_ring_cell{
+	unsigned long seq; //which round of enq/deq the cell is ready for
+	void *data;
+};
+
+typedef struct ts_ring TSRing;
+
+struct ts_ring{
+	unsigned long head; //next position to dequeue
+	char pad0[TS_CACHE_LINE - sizeof(unsigned long)];
+	unsigned long tail; //next position to enqueue
+	char pad1[TS_CACHE_LINE - sizeof(unsigned long)];
+	unsigned long mask; //size - 1, size is power of 2
+	TSRingCell *cells;
+};
+
+TSRing *ts_ring_create(unsigned size);
+void ts_ring_destroy(TSRing *rq);
+
+void *ts_ring_deq_data(TSRing *rq);
+int ts_ring_enq_data(TSRing *rq, void *data);
+
+unsigned ts_ring_count(TSRing *rq);
+BOOL ts_ring_is_empty(TSRing *rq);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
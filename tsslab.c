@@ -0,0 +1,200 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  tsslab.c
+ *
+ *    Description:  a thread safe slab of fixed size objects. a thread with a cache
+ *                  allocates and frees without locking, the cache is refilled from
+ *                  or flushed to the shared list half a cache at a time. free
+ *                  objects are linked by their first word.
+ *
+ *        Version:  1.0
+ *        Created:  10/18/2026 08:41:27 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Tristan Lee
+ *   Organization:  gw
+ *
+ * =====================================================================================
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "tsslab.h"
+
+#define TS_SLAB_NEXT(obj) (*(void **)(obj))
+
+static void *ts_slab_malloc(size_t size, void *ctx){
+	(void) ctx;
+	return malloc(size);
+}
+
+static int ts_slab_grow(TSSlab *slab);
+static void *ts_slab_take(TSSlab *slab, unsigned n, unsigned *got);
+
+TSSlab *ts_slab_create(size_t size, unsigned count, unsigned cache_num, unsigned cache_max){
+	return ts_slab_create_ex(size, count, cache_num, cache_max, NULL, NULL);
+}
+
+TSSlab *ts_slab_create_ex(size_t size, unsigned count, unsigned cache_num, unsigned cache_max,
+		void *(*alloc)(size_t size, void *ctx), void *ctx){
+	TSSlab *slab;
+
+	if(!size || !count)
+		return NULL;
+	if(posix_memalign((void **) &slab, TS_CACHE_LINE, sizeof(TSSlab)) != 0)
+		return NULL;
+	memset(slab, 0, sizeof(TSSlab));
+	//objects used by different threads don't share a cache line
+	slab->size = (size + TS_CACHE_LINE - 1) & ~(size_t)(TS_CACHE_LINE - 1);
+	slab->count = count;
+	slab->cache_num = cache_num;
+	slab->cache_max = cache_max < 2 ? 2 : cache_max;
+	slab->alloc = alloc ? alloc : ts_slab_malloc;
+	slab->ctx = ctx;
+	pthread_mutex_init(&slab->lock, NULL);
+
+	if(cache_num){
+		if(posix_memalign((void **) &slab->caches, TS_CACHE_LINE, cache_num * sizeof(TSSlabCache)) != 0){
+			slab->caches = NULL;
+			ts_slab_destroy(slab);
+			return NULL;
+		}
+		memset(slab->caches, 0, cache_num * sizeof(TSSlabCache));
+	}
+	if(ts_slab_grow(slab) != 0){
+		ts_slab_destroy(slab);
+		return NULL;
+	}
+	return slab;
+}
+
+void ts_slab_destroy(TSSlab *slab){
+	void *chunk;
+
+	if(!slab)
+		return;
+	while((chunk = slab->chunks) != NULL){
+		slab->chunks = TS_SLAB_NEXT(chunk);
+		free(chunk);
+	}
+	pthread_mutex_destroy(&slab->lock);
+	free(slab->caches);
+	free(slab);
+}
+
+void *ts_slab_alloc(TSSlab *slab, unsigned cache){
+	TSSlabCache *cc;
+	void *obj;
+	unsigned got;
+
+	if(!slab)
+		return NULL;
+
+	if(cache >= slab->cache_num){
+		pthread_mutex_lock(&slab->lock);
+		obj = ts_slab_take(slab, 1, &got);
+		pthread_mutex_unlock(&slab->lock);
+		return obj;
+	}
+
+	cc = &slab->caches[cache];
+	if(!cc->free){
+		//refill half the cache at a time, so the lock is taken rarely
+		pthread_mutex_lock(&slab->lock);
+		cc->free = ts_slab_take(slab, slab->cache_max / 2, &cc->count);
+		pthread_mutex_unlock(&slab->lock);
+		if(!cc->free)
+			return NULL;
+	}
+	obj = cc->free;
+	cc->free = TS_SLAB_NEXT(obj);
+	cc->count--;
+	return obj;
+}
+
+void ts_slab_free(TSSlab *slab, void *obj, unsigned cache){
+	TSSlabCache *cc;
+	void *head, *tail;
+	unsigned i;
+
+	if(!slab || !obj)
+		return;
+
+	if(cache >= slab->cache_num){
+		pthread_mutex_lock(&slab->lock);
+		TS_SLAB_NEXT(obj) = slab->free;
+		slab->free = obj;
+		pthread_mutex_unlock(&slab->lock);
+		return;
+	}
+
+	cc = &slab->caches[cache];
+	TS_SLAB_NEXT(obj) = cc->free;
+	cc->free = obj;
+	if(++cc->count <= slab->cache_max)
+		return;
+
+	//a thread freeing more than it allocates, give half the cache back
+	head = tail = cc->free;
+	for(i = 1; i < slab->cache_max / 2; i++)
+		tail = TS_SLAB_NEXT(tail);
+	cc->free = TS_SLAB_NEXT(tail);
+	cc->count -= i;
+	pthread_mutex_lock(&slab->lock);
+	TS_SLAB_NEXT(tail) = slab->free;
+	slab->free = head;
+	pthread_mutex_unlock(&slab->lock);
+}
+
+unsigned long ts_slab_chunks(TSSlab *slab){
+	return slab ? __atomic_load_n(&slab->chunk_num, __ATOMIC_RELAXED) : 0;
+}
+
+/**
+ * allocate a chunk and put its objects into the shared list, lock must be held
+ * except in creation. the chunk is linked by its first word, objects start
+ * at the next cache line.
+ */
+static int ts_slab_grow(TSSlab *slab){
+	char *chunk, *obj;
+	unsigned i;
+
+	chunk = (char *) slab->alloc(slab->count * slab->size + 2 * TS_CACHE_LINE, slab->ctx);
+	if(!chunk)
+		return -1;
+	TS_SLAB_NEXT(chunk) = slab->chunks;
+	slab->chunks = chunk;
+	__atomic_store_n(&slab->chunk_num, slab->chunk_num + 1, __ATOMIC_RELAXED);
+
+	obj = (char *) (((size_t) chunk + sizeof(void *) + TS_CACHE_LINE - 1) & ~(size_t)(TS_CACHE_LINE - 1));
+	for(i = 0; i < slab->count; i++, obj += slab->size){
+		TS_SLAB_NEXT(obj) = slab->free;
+		slab->free = obj;
+	}
+	return 0;
+}
+
+/**
+ * take up to n objects from the shared list as a list, lock must be held.
+ * a new chunk is allocated if the list is empty.
+ */
+static void *ts_slab_take(TSSlab *slab, unsigned n, unsigned *got){
+	void *head, *tail;
+	unsigned i;
+
+	*got = 0;
+	if(!slab->free && ts_slab_grow(slab) != 0)
+		return NULL;
+	if(!n)
+		n = 1;
+
+	head = tail = slab->free;
+	for(i = 1; i < n && TS_SLAB_NEXT(tail); i++)
+		tail = TS_SLAB_NEXT(tail);
+	slab->free = TS_SLAB_NEXT(tail);
+	TS_SLAB_NEXT(tail) = NULL;
+	*got = i;
+	return head;
+}
@@ -0,0 +1,78 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  tsslab.h
+ *
+ *    Description:  a thread safe slab of fixed size objects, each thread may have a
+ *                  cache of free objects of its own, memory is allocated in chunks
+ *                  and only released when the slab is destroyed
+ *
+ *        Version:  1.0
+ *        Created:  10/18/2026 08:41:27 PM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Tristan Lee
+ *   Organization:  gw
+ *
+ * =====================================================================================
+ */
+
+#ifndef B_TS_SLAB_H__
+#define B_TS_SLAB_H__
+
+#include <stddef.h>
+#include <pthread.h>
+
+#ifndef TS_CACHE_LINE
+#define TS_CACHE_LINE 64
+#endif
+
+#define TS_SLAB_SHARED ((unsigned) -1)	//cache index of threads without a cache, they use the shared list
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ts_slab_cache TSSlabCache;
+
+//free objects of a thread, touched by the thread only
+struct ts_slab_cache{
+	void *free;
+	unsigned count;
+} __attribute__((aligned(TS_CACHE_LINE)));
+
+typedef struct ts_slab TSSlab;
+
+struct ts_slab{
+	size_t size; //object size, rounded up to TS_CACHE_LINE
+	unsigned count; //objects in a chunk
+	unsigned cache_num; //number of thread caches
+	unsigned cache_max; //objects kept in a cache, half of them go back to the shared list when it's full
+	pthread_mutex_t lock; //protect the shared list and chunks
+	void *free; //shared free list
+	void *chunks; //chunks allocated, linked by their first word
+	unsigned long chunk_num;
+	void *(*alloc)(size_t size, void *ctx);
+	void *ctx;
+	TSSlabCache *caches;
+};
+
+//the first chunk is allocated here
+TSSlab *ts_slab_create(size_t size, unsigned count, unsigned cache_num, unsigned cache_max);
+//alloc returns memory which can be released by free(), NULL - malloc
+TSSlab *ts_slab_create_ex(size_t size, unsigned count, unsigned cache_num, unsigned cache_max,
+		void *(*alloc)(size_t size, void *ctx), void *ctx);
+void ts_slab_destroy(TSSlab *slab); //all objects are released, in use or not
+
+//cache - index of the cache used by the calling thread only, TS_SLAB_SHARED - none
+void *ts_slab_alloc(TSSlab *slab, unsigned cache);
+void ts_slab_free(TSSlab *slab, void *obj, unsigned cache);
+
+unsigned long ts_slab_chunks(TSSlab *slab); //chunks allocated so far
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
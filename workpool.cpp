@@ -24,25 +24,62 @@ WorkPool::WorkPool(unsigned min, unsigned max)
     InitInner();
 }
 
+WorkPool::WorkPool(unsigned min, unsigned max, const TpAttr &attr)
+{
+	if (!min) min = WORKPOOL_DEF_MIN;
+    if (!max) max = WORKPOOL_DEF_MAX;
+
+    mMinNr = min;
+    mMaxNr = max;
+    mPool = NULL;
+    InitInner(&attr);
+}
+
 WorkPool::~WorkPool(void)
 {
-    tp_close(mPool, 1);
+    if (mPool) tp_close(mPool, 1);
     mPool = NULL;
 }
 
-int WorkPool::InitInner(void)
+int WorkPool::InitInner(const TpAttr *attr)
 {    
-    mPool = tp_create(mMinNr, mMaxNr);
+    mPool = tp_create_ex(mMinNr, mMaxNr, attr);
     if (!mPool) return -1;
 
     return 0;
 }
 
+int WorkPool::Shutdown(unsigned mode, int timeout)
+{
+    return tp_shutdown(mPool, mode, timeout);
+}
+
 int WorkPool::DoJob(WorkJobT job, void *arg)
 {
     return tp_process_job(mPool, (process_job)job, arg);
 }
 
+int WorkPool::DoJobWait(WorkJobT job, void *arg, int timeout)
+{
+    return tp_process_job_timed(mPool, (process_job)job, arg, timeout);
+}
+
+int WorkPool::DoJobPrio(WorkJobT job, void *arg, unsigned prio, int timeout)
+{
+    return tp_process_job_prio(mPool, (process_job)job, arg, prio, timeout);
+}
+
+int WorkPool::DoJobCancel(WorkJobT job, void *arg, TpCancel *c,
+                          const struct timespec *deadline, int timeout)
+{
+    return tp_process_job_cancel(mPool, (process_job)job, arg, c, deadline, timeout);
+}
+
+int WorkPool::DoJobs(WorkJobT job, void **args, unsigned n, int timeout)
+{
+    return tp_process_jobs_timed(mPool, (process_job)job, args, n, timeout);
+}
+
 float WorkPool::GetBusyThreshold(void)
 {
     return tp_get_busy_threshold(mPool);
@@ -63,3 +100,98 @@ int WorkPool::SetManageInterval(unsigned mi)
     return tp_set_manage_interval(mPool, mi);
 }
 
+unsigned WorkPool::GetSampleInterval(void)
+{
+    return tp_get_sample_interval(mPool);
+}
+
+int WorkPool::SetSampleInterval(unsigned si)
+{
+    return tp_set_sample_interval(mPool, si);
+}
+
+unsigned WorkPool::GetReserve(void)
+{
+    return tp_get_reserve(mPool);
+}
+
+int WorkPool::SetReserve(unsigned reserve)
+{
+    return tp_set_reserve(mPool, reserve);
+}
+
+int WorkPool::PrestartAll(void)
+{
+    return tp_prestart_all(mPool);
+}
+
+unsigned WorkPool::GetSpinCount(void)
+{
+    return tp_get_spin_count(mPool);
+}
+
+int WorkPool::SetSpinCount(unsigned spin)
+{
+    return tp_set_spin_count(mPool, spin);
+}
+
+int WorkPool::GetStats(TpStats *stats, TpWorkerStats *workers, unsigned n)
+{
+    return tp_get_stats(mPool, stats, workers, n);
+}
+
+int WorkPool::SetTiming(bool on)
+{
+    return tp_set_timing(mPool, on);
+}
+
+int WorkPool::GetLatency(unsigned which, TpLatency *lat)
+{
+    return tp_get_latency(mPool, which, lat);
+}
+
+int WorkPool::SetTracing(bool on)
+{
+    return tp_set_tracing(mPool, on);
+}
+
+int WorkPool::DumpTrace(const char *path)
+{
+    return tp_trace_dump_file(mPool, path);
+}
+
+unsigned WorkPool::GetQueueCapacity(void)
+{
+    return tp_get_queue_capacity(mPool);
+}
+
+int WorkPool::SetQueueCapacity(unsigned cap)
+{
+    return tp_set_queue_capacity(mPool, cap);
+}
+
+unsigned WorkPool::GetPrioWeight(unsigned prio)
+{
+    return tp_get_prio_weight(mPool, prio);
+}
+
+int WorkPool::SetPrioWeight(unsigned prio, unsigned weight)
+{
+    return tp_set_prio_weight(mPool, prio, weight);
+}
+
+int WorkPool::GetPrioStats(unsigned prio, TpPrioStats *stats)
+{
+    return tp_get_prio_stats(mPool, prio, stats);
+}
+
+unsigned WorkPool::GetPolicy(void)
+{
+    return tp_get_policy(mPool);
+}
+
+int WorkPool::SetPolicy(unsigned policy, overflow_job fun, void *arg)
+{
+    return tp_set_policy(mPool, policy, fun, arg);
+}
+
@@ -1,35 +1,361 @@
 #ifndef __WORKPOOL_H__
 #define __WORKPOOL_H__
 
+#include <atomic>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include "thread_pool.h"
+#include "tp_parallel.h"
 
 #define WORKPOOL_DEF_MIN    5
 #define WORKPOOL_DEF_MAX    100
 
 typedef void (*WorkJobT)(void *arg);
 
+namespace workpool_detail {
+
+template <std::size_t... I> struct IndexSeq {};
+template <std::size_t N, std::size_t... I>
+struct MakeIndexSeq : MakeIndexSeq<N - 1, N - 1, I...> {};
+template <std::size_t... I>
+struct MakeIndexSeq<0, I...> { typedef IndexSeq<I...> Type; };
+
+// a callable and its arguments, kept in the job data of a TpJob
+template <class Fn, class... Args>
+struct Task
+{
+    typedef decltype(std::declval<Fn>()(std::declval<Args>()...)) Result;
+
+    template <class F, class... A>
+    explicit Task(F &&f, A &&... a)
+        : mFn(std::forward<F>(f)), mArgs(std::forward<A>(a)...) {}
+
+    Result Invoke() { return Apply(typename MakeIndexSeq<sizeof...(Args)>::Type()); }
+
+    template <std::size_t... I>
+    Result Apply(IndexSeq<I...>) { return std::move(mFn)(std::get<I>(std::move(mArgs))...); }
+
+    // no one waits for the result, an exception can't be reported anywhere
+    void Run() noexcept { Invoke(); }
+
+    Fn mFn;
+    std::tuple<Args...> mArgs;
+};
+
+// a task with a promise receiving its result or exception
+template <class Fn, class... Args>
+struct FutureTask
+{
+    typedef typename Task<Fn, Args...>::Result Result;
+
+    template <class F, class... A>
+    explicit FutureTask(F &&f, A &&... a)
+        : mTask(std::forward<F>(f), std::forward<A>(a)...) {}
+
+    void Run() noexcept
+    {
+        try {
+            SetValue(mPromise, mTask);
+        } catch (...) {
+            mPromise.set_exception(std::current_exception());
+        }
+    }
+
+    template <class R>
+    static void SetValue(std::promise<R> &p, Task<Fn, Args...> &t) { p.set_value(t.Invoke()); }
+    static void SetValue(std::promise<void> &p, Task<Fn, Args...> &t) { t.Invoke(); p.set_value(); }
+
+    std::promise<Result> mPromise;
+    Task<Fn, Args...> mTask;
+};
+
+// body of ParallelFor()/ParallelReduce(), the first exception thrown by a
+// chunk is kept and rethrown by the caller, chunks left are skipped
+template <class Derived>
+struct RangeBody
+{
+    RangeBody() : mFailed(false) {}
+
+    static void Run(void *arg, long b, long e)
+    {
+        Derived *body = static_cast<Derived *>(arg);
+        if (body->mFailed.load(std::memory_order_relaxed)) return;
+        try {
+            body->Call(b, e);
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(body->mLock);
+            if (!body->mError) body->mError = std::current_exception();
+            body->mFailed.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    void Rethrow() { if (mError) std::rethrow_exception(mError); }
+
+    std::atomic<bool> mFailed;
+    std::mutex mLock;
+    std::exception_ptr mError;
+};
+
+template <class Index, class F>
+struct ForBody : RangeBody<ForBody<Index, F> >
+{
+    explicit ForBody(F &fn) : mFn(fn) {}
+
+    void Call(long b, long e)
+    {
+        for (long i = b; i < e; ++i) mFn(static_cast<Index>(i));
+    }
+
+    F &mFn;
+};
+
+template <class Index, class T, class F, class J>
+struct ReduceBody : RangeBody<ReduceBody<Index, T, F, J> >
+{
+    ReduceBody(const T &identity, F &fn, J &join)
+        : mIdentity(identity), mResult(identity), mFn(fn), mJoin(join) {}
+
+    // chunks are few, merging each one under the lock costs little
+    void Call(long b, long e)
+    {
+        T partial = mFn(static_cast<Index>(b), static_cast<Index>(e), mIdentity);
+        std::lock_guard<std::mutex> guard(this->mLock);
+        mResult = mJoin(std::move(mResult), std::move(partial));
+    }
+
+    const T mIdentity;
+    T mResult;
+    F &mFn;
+    J &mJoin;
+};
+
+} // namespace workpool_detail
+
 class WorkPool
 {
 public:
     WorkPool(unsigned min = WORKPOOL_DEF_MIN, unsigned max = WORKPOOL_DEF_MAX);
+    // attr - thread placement options, see tp_create_ex()
+    WorkPool(unsigned min, unsigned max, const TpAttr &attr);
     virtual ~WorkPool();
+
+    // stop accepting jobs and stop the threads, jobs submitted later get
+    // TP_ESHUTDOWN. return number of jobs dropped, see tp_shutdown()
+    int Shutdown(unsigned mode = TP_SHUTDOWN_DRAIN, int timeout = 0);
     
     int DoJob(WorkJobT job, void *arg);
+    int DoJobWait(WorkJobT job, void *arg, int timeout = TP_WAIT_FOREVER);
+    // prio - TP_PRIO_HIGH, TP_PRIO_NORMAL or TP_PRIO_LOW
+    int DoJobPrio(WorkJobT job, void *arg, unsigned prio, int timeout = 0);
+    // dropped without running once c is cancelled or deadline (CLOCK_MONOTONIC)
+    // is passed, the job may poll tp_job_cancelled() while running
+    int DoJobCancel(WorkJobT job, void *arg, TpCancel *c,
+                    const struct timespec *deadline = NULL, int timeout = 0);
+
+    // batch of jobs queued at once, return number of jobs queued
+    int DoJobs(WorkJobT job, void **args, unsigned n, int timeout = 0);
+    // job is called with a pointer to each element in [first, last)
+    template <class Iter>
+    int DoJobs(WorkJobT job, Iter first, Iter last, int timeout = 0);
+
+    // run f(args...) in the pool, the future gets its return value or
+    // exception. f and args are moved into the job itself, so the callable
+    // needs no allocation of its own. wait until queued.
+    template <class F, class... Args>
+    std::future<typename workpool_detail::Task<typename std::decay<F>::type,
+        typename std::decay<Args>::type...>::Result>
+    Submit(F &&f, Args &&... args);
+
+    // same as Submit() but without result, an exception thrown by f calls
+    // std::terminate()
+    template <class F, class... Args>
+    int Post(F &&f, Args &&... args);
+
     float GetBusyThreshold(void);
     int SetBusyThreshold(float bt);
     unsigned GetManageInterval(void);
     int SetManageInterval(unsigned mi);
+    unsigned GetSampleInterval(void);
+    int SetSampleInterval(unsigned si);
+    // idle threads kept ready, so submitters never wait for thread creation
+    unsigned GetReserve(void);
+    int SetReserve(unsigned reserve);
+    // start threads up to the max number, return number of threads started
+    int PrestartAll(void);
+    unsigned GetSpinCount(void);
+    int SetSpinCount(unsigned spin);
+
+    // fn(i) for each i in [begin, end), grain indexes per chunk (0 - auto),
+    // the calling thread takes part and returns when all are done
+    template <class Index, class F>
+    void ParallelFor(Index begin, Index end, Index grain, F &&fn);
+
+    // reduce [begin, end) with fn(b, e, identity) -> T for each chunk, chunk
+    // results are merged by join(T, T) -> T in any order
+    template <class Index, class T, class F, class J>
+    T ParallelReduce(Index begin, Index end, Index grain, const T &identity, F &&fn, J &&join);
+    // workers - counters of n thread slots at most, return number of slots
+    int GetStats(TpStats *stats, TpWorkerStats *workers = NULL, unsigned n = 0);
+    // time jobs queued from now on, see GetLatency()
+    int SetTiming(bool on);
+    // which - TP_LAT_WAIT or TP_LAT_RUN
+    int GetLatency(unsigned which, TpLatency *lat);
+    // trace events from now on, see DumpTrace()
+    int SetTracing(bool on);
+    // write events traced in chrome trace json
+    int DumpTrace(const char *path);
+    unsigned GetQueueCapacity(void);
+    int SetQueueCapacity(unsigned cap);
+    unsigned GetPrioWeight(unsigned prio);
+    int SetPrioWeight(unsigned prio, unsigned weight);
+    int GetPrioStats(unsigned prio, TpPrioStats *stats);
+    // what to do with a job the pending queue has no room for, TP_POLICY_*,
+    // also set at construction by TpAttr::policy. fun - callback of
+    // TP_POLICY_CALLBACK
+    unsigned GetPolicy(void);
+    int SetPolicy(unsigned policy, overflow_job fun = NULL, void *arg = NULL);
 
 protected:
 
 private:
 
-    int InitInner(void);
+    int InitInner(const TpAttr *attr = NULL);
+
+    template <class T, class... A>
+    TpJob *NewTask(A &&... a);
+
+    template <class T>
+    static void RunTask(void *arg);
+    template <class T>
+    static void DropTask(void *arg);
 
     unsigned mMinNr, mMaxNr;
     TpThreadPool *mPool;
 
 };
 
+template <class F, class... Args>
+std::future<typename workpool_detail::Task<typename std::decay<F>::type,
+    typename std::decay<Args>::type...>::Result>
+WorkPool::Submit(F &&f, Args &&... args)
+{
+    typedef workpool_detail::FutureTask<typename std::decay<F>::type,
+        typename std::decay<Args>::type...> T;
+    typedef typename T::Result R;
+
+    TpJob *job = NewTask<T>(std::forward<F>(f), std::forward<Args>(args)...);
+    if (!job) {
+        std::promise<R> p;
+        p.set_exception(std::make_exception_ptr(std::bad_alloc()));
+        return p.get_future();
+    }
+
+    std::future<R> fut = static_cast<T *>(job->arg)->mPromise.get_future();
+    // the task is dropped without running if it can't be queued, then the
+    // future reports std::future_errc::broken_promise
+    if (tp_process_job_ex(mPool, job, TP_WAIT_FOREVER) != 0) {
+        DropTask<T>(job->arg);
+        tp_job_destroy(job);
+    }
+    return fut;
+}
+
+template <class F, class... Args>
+int WorkPool::Post(F &&f, Args &&... args)
+{
+    typedef workpool_detail::Task<typename std::decay<F>::type,
+        typename std::decay<Args>::type...> T;
+
+    TpJob *job = NewTask<T>(std::forward<F>(f), std::forward<Args>(args)...);
+    if (!job) return -1;
+
+    int err = tp_process_job_ex(mPool, job, TP_WAIT_FOREVER);
+    if (err != 0) {
+        DropTask<T>(job->arg);
+        tp_job_destroy(job);
+    }
+    return err;
+}
+
+template <class Iter>
+int WorkPool::DoJobs(WorkJobT job, Iter first, Iter last, int timeout)
+{
+    void *args[TP_BATCH_SIZE];
+    unsigned n;
+    int queued, done = 0;
+
+    while (first != last) {
+        for (n = 0; n < TP_BATCH_SIZE && first != last; ++n, ++first)
+            args[n] = static_cast<void *>(&*first);
+        queued = DoJobs(job, args, n, timeout);
+        if (queued < 0) return done ? done : -1;
+        done += queued;
+        if ((unsigned)queued < n) break;
+    }
+    return done;
+}
+
+template <class Index, class F>
+void WorkPool::ParallelFor(Index begin, Index end, Index grain, F &&fn)
+{
+    typedef workpool_detail::ForBody<Index, typename std::remove_reference<F>::type> Body;
+    Body body(fn);
+
+    // if the loop can't be spread, run it here
+    if (tp_parallel_for(mPool, static_cast<long>(begin), static_cast<long>(end),
+                static_cast<long>(grain), Body::Run, &body) != 0)
+        Body::Run(&body, static_cast<long>(begin), static_cast<long>(end));
+    body.Rethrow();
+}
+
+template <class Index, class T, class F, class J>
+T WorkPool::ParallelReduce(Index begin, Index end, Index grain, const T &identity, F &&fn, J &&join)
+{
+    typedef workpool_detail::ReduceBody<Index, T, typename std::remove_reference<F>::type,
+        typename std::remove_reference<J>::type> Body;
+    Body body(identity, fn, join);
+
+    if (tp_parallel_for(mPool, static_cast<long>(begin), static_cast<long>(end),
+                static_cast<long>(grain), Body::Run, &body) != 0)
+        Body::Run(&body, static_cast<long>(begin), static_cast<long>(end));
+    body.Rethrow();
+    return std::move(body.mResult);
+}
+
+template <class T, class... A>
+TpJob *WorkPool::NewTask(A &&... a)
+{
+    static_assert(alignof(T) <= alignof(long double), "task is over-aligned for TpJob");
+
+    TpJob *job = tp_job_create_ex(mPool, RunTask<T>, DropTask<T>, sizeof(T));
+    if (!job) return NULL;
+    try {
+        new (job->arg) T(std::forward<A>(a)...);
+    } catch (...) {
+        tp_job_destroy(job);
+        throw;
+    }
+    return job;
+}
+
+template <class T>
+void WorkPool::RunTask(void *arg)
+{
+    T *task = static_cast<T *>(arg);
+    task->Run();
+    task->~T();
+}
+
+template <class T>
+void WorkPool::DropTask(void *arg)
+{
+    static_cast<T *>(arg)->~T();
+}
+
 #endif // __WORKPOOL_H__
 
@@ -0,0 +1,137 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  wsdeque.c
+ *
+ *    Description:  a lock free work stealing deque (Chase-Lev), the owner thread
+ *                  pushes and pops at the bottom, other threads steal from the top.
+ *                  the buffer has a fixed size, push fails when it's full.
+ *
+ *        Version:  1.0
+ *        Created:  10/18/2026 10:12:05 AM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Tristan Lee
+ *   Organization:  gw
+ *
+ * =====================================================================================
+ */
+#include <stdlib.h>
+#include "wsdeque.h"
+
+static void *ws_deque_calloc(size_t size, void *ctx){
+	(void) ctx;
+	return calloc(1, size);
+}
+
+WSDeque *ws_deque_create(unsigned size){
+	return ws_deque_create_ex(size, NULL, NULL);
+}
+
+WSDeque *ws_deque_create_ex(unsigned size, void *(*alloc)(size_t size, void *ctx), void *ctx){
+	WSDeque *dq;
+	unsigned long n = 1;
+
+	if(!size)
+		return NULL;
+	while(n < size)
+		n <<= 1;
+	if(!alloc)
+		alloc = ws_deque_calloc;
+
+	dq = (WSDeque *) alloc(sizeof(WSDeque), ctx);
+	if(!dq)
+		return NULL;
+	dq->buf = (void **) alloc(n * sizeof(void *), ctx);
+	if(!dq->buf){
+		free(dq);
+		return NULL;
+	}
+	dq->mask = n - 1;
+	dq->top = 0;
+	dq->bottom = 0;
+	return dq;
+}
+
+void ws_deque_destroy(WSDeque *dq){
+	if(!dq)
+		return;
+	free(dq->buf);
+	free(dq);
+}
+
+int ws_deque_push(WSDeque *dq, void *data){
+	long b, t;
+
+	if(!dq || !data)
+		return -1;
+
+	b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+	t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+	if(b - t > (long)dq->mask)
+		return -1; //full
+
+	__atomic_store_n(&dq->buf[b & dq->mask], data, __ATOMIC_RELAXED);
+	__atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void *ws_deque_pop(WSDeque *dq){
+	long b, t;
+	void *data = NULL;
+
+	if(!dq)
+		return NULL;
+
+	b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED) - 1;
+	__atomic_store_n(&dq->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	t = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+
+	if(t <= b){
+		data = __atomic_load_n(&dq->buf[b & dq->mask], __ATOMIC_RELAXED);
+		if(t == b){
+			//the last one, race with thieves
+			if(!__atomic_compare_exchange_n(&dq->top, &t, t + 1, 0,
+						__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+				data = NULL;
+			__atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+		}
+	}
+	else{
+		//empty
+		__atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+	}
+	return data;
+}
+
+void *ws_deque_steal(WSDeque *dq){
+	long b, t;
+	void *data;
+
+	if(!dq)
+		return NULL;
+
+	t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	b = __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+	if(t >= b)
+		return NULL; //empty
+
+	data = __atomic_load_n(&dq->buf[t & dq->mask], __ATOMIC_RELAXED);
+	if(!__atomic_compare_exchange_n(&dq->top, &t, t + 1, 0,
+				__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		return NULL; //lost the race with another thief or the owner
+	return data;
+}
+
+unsigned ws_deque_count(WSDeque *dq){
+	long b, t;
+
+	if(!dq)
+		return 0;
+	t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+	b = __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+	return b > t ? (unsigned)(b - t) : 0;
+}
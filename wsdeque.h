@@ -0,0 +1,62 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  wsdeque.h
+ *
+ *    Description:  a lock free work stealing deque (Chase-Lev), the owner thread
+ *                  pushes and pops at the bottom, other threads steal from the top
+ *
+ *        Version:  1.0
+ *        Created:  10/18/2026 10:12:05 AM
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  Tristan Lee
+ *   Organization:  gw
+ *
+ * =====================================================================================
+ */
+
+#ifndef B_WS_DEQUE_H__
+#define B_WS_DEQUE_H__
+
+#ifndef WS_CACHE_LINE
+#define WS_CACHE_LINE 64
+#endif
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ws_deque WSDeque;
+
+struct ws_deque{
+	long top; //next index to steal, modified by thieves
+	char pad0[WS_CACHE_LINE - sizeof(long)];
+	long bottom; //next index to push, modified by the owner only
+	char pad1[WS_CACHE_LINE - sizeof(long)];
+	unsigned long mask; //size - 1, size is power of 2
+	void **buf;
+};
+
+WSDeque *ws_deque_create(unsigned size);
+//alloc returns zeroed memory which can be released by free(), NULL - calloc
+WSDeque *ws_deque_create_ex(unsigned size, void *(*alloc)(size_t size, void *ctx), void *ctx);
+void ws_deque_destroy(WSDeque *dq);
+
+//owner side
+int ws_deque_push(WSDeque *dq, void *data);
+void *ws_deque_pop(WSDeque *dq);
+
+//thief side
+void *ws_deque_steal(WSDeque *dq);
+
+unsigned ws_deque_count(WSDeque *dq);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif